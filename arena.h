@@ -27,122 +27,659 @@
 #endif /* ARENA_NO_STDIO */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifndef ARENADEF
 #define ARENADEF static inline
 #endif /* ARENADEF */
 
+/*
+ * Tracepoints, compiled in with ARENA_TRACE. They are USDT probes (provider "arena") when <sys/sdt.h> is available,
+ * so perf/bpftrace can attach to them in a live process, and they also call ARENA_TRACE_HOOK(event, arena, ptr,
+ * size, extra) when the user defines it. Without ARENA_TRACE they compile to nothing. Probe arguments:
+ *   alloc:      arena, ptr, size, align        region:     arena, region, size, total
+ *   alloc_many: arena, ptrs, size, count       deinit:     arena, NULL, total, 0
+ *   free:       arena, ptr, size, 0            realloc:    arena, new ptr, size, old ptr
+ * where align is the alignment passed to arena_alloc_aligned, and 0 for arena_alloc.
+ */
+#ifdef ARENA_TRACE
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define _ARENA_TRACE_SDT(name, a, p, n, x)  DTRACE_PROBE4(arena, name, (a), (p), (n), (x))
+#endif
+#endif /* __has_include */
+#ifndef _ARENA_TRACE_SDT
+#define _ARENA_TRACE_SDT(name, a, p, n, x)
+#endif
+#ifdef ARENA_TRACE_HOOK
+#define _ARENA_TRACE(name, a, p, n, x)      do { _ARENA_TRACE_SDT(name, a, p, n, x); ARENA_TRACE_HOOK(#name, (a), (p), (n), (x)); } while (0)
+#else
+#define _ARENA_TRACE(name, a, p, n, x)      _ARENA_TRACE_SDT(name, a, p, n, x)
+#endif /* ARENA_TRACE_HOOK */
+#else
+#define _ARENA_TRACE(name, a, p, n, x)
+#endif /* ARENA_TRACE */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && !defined(ARENA_NO_STREAM)
+#include <immintrin.h>
+#define _ARENA_STREAM_COPY                  /* non-temporal stores for large copies */
+#endif
+
+#ifndef ARENA_PAGE_SIZE                     /* regions are sized in whole pages of this many bytes */
+#define ARENA_PAGE_SIZE                     4096
+#endif /* ARENA_PAGE_SIZE */
+
+#ifndef ARENA_CACHELINE                     /* region headers are padded to a cache line */
+#define ARENA_CACHELINE                     64
+#endif /* ARENA_CACHELINE */
+
 #ifdef ARENA_MMAP_BACKEND                   /* use mmap/munmap for portability (and speed) */
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #define _ARENA_INVALID_ALLOC                MAP_FAILED
 #define _ARENA_BACKEND_ALLOC(size)          mmap(NULL, (size), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)
 #define _ARENA_BACKEND_DEALLOC(addr, size)  munmap((addr), (size))
+#ifdef MAP_POPULATE                         /* let the kernel fault the pages in while mapping them */
+#define _ARENA_BACKEND_ALLOC_POPULATED(size) mmap(NULL, (size), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0)
+#else
+#define _ARENA_BACKEND_ALLOC_POPULATED(size) _arena_prefault(_ARENA_BACKEND_ALLOC(size), (size))
+#endif /* MAP_POPULATE */
+#if defined(MADV_FREE) && !defined(ARENA_RELEASE_EAGER) /* lazily free the pages, unless the mapping can't */
+#define _ARENA_BACKEND_RELEASE(addr, size)  do { if (madvise((addr), (size), MADV_FREE)) madvise((addr), (size), MADV_DONTNEED); } while (0)
+#else
+#define _ARENA_BACKEND_RELEASE(addr, size)  ((void)madvise((addr), (size), MADV_DONTNEED))
+#endif /* MADV_FREE */
 
 #else                                       /* defaults to malloc/free */
 
-#include <stdlib.h>
 #define _ARENA_INVALID_ALLOC                NULL
+#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L) || (defined(__cplusplus) && __cplusplus >= 201703L)
+#define _ARENA_BACKEND_ALLOC(size)          aligned_alloc(ARENA_PAGE_SIZE, (size))
+#else                                       /* aligned_alloc is C11, older standards get malloc's alignment */
 #define _ARENA_BACKEND_ALLOC(size)          malloc((size))
+#endif /* __STDC_VERSION__ */
 #define _ARENA_BACKEND_DEALLOC(addr, size)  free((addr))
+#define _ARENA_BACKEND_ALLOC_POPULATED(size) _arena_prefault(_ARENA_BACKEND_ALLOC(size), (size))
 #endif /* ARENA_MMAP_BACKEND */
 
 /* 4KB is the most common page size, so by default the arena will allocate 2 pages on most systems */
-#define ARENA_DEFAULT_CAPACITY             (2 * 4096)
+#define ARENA_DEFAULT_CAPACITY             (2 * ARENA_PAGE_SIZE)
 
+#ifndef ARENA_STREAM_THRESHOLD              /* copies of at least this many bytes bypass the cache */
+#define ARENA_STREAM_THRESHOLD              ((size_t)1 << 20)
+#endif /* ARENA_STREAM_THRESHOLD */
+
+#ifndef ARENA_RETIRE_THRESHOLD              /* regions with less free space than this stop being searched, until freed */
+#define ARENA_RETIRE_THRESHOLD              64
+#endif /* ARENA_RETIRE_THRESHOLD */
+
+#ifndef ARENA_HANDLE_ALIGN                  /* alignment of the blocks of arena_handle_alloc, kept by arena_compact */
+#define ARENA_HANDLE_ALIGN                  ((size_t)16)
+#endif /* ARENA_HANDLE_ALIGN */
+
+#ifndef ARENA_RETAIN_SIZE                   /* bytes of regions kept resident when the arena is reset or rewound */
+#define ARENA_RETAIN_SIZE                   ((size_t)1 << 20)
+#endif /* ARENA_RETAIN_SIZE */
+
+/*
+ * Regions start on a page boundary and span whole pages. The header is padded to a cache line, so mem[] starts
+ * cache-line aligned and writes to the header (offset, on every allocation) don't share a line with the data.
+ */
 struct _memory_region {
     size_t                  size;
     size_t                  offset;
-    struct _memory_region   *next;
+    struct _memory_region   *next;          /* all regions, in creation order */
+    struct _memory_region   *next_avail;    /* regions with room for allocations */
+    size_t                  index;          /* position in creation order, see arena_mark */
+    size_t                  retired;        /* set while it is left out of avail for lack of room */
+    char                    pad[ARENA_CACHELINE - 4 * sizeof(size_t) - 2 * sizeof(void *)];
     char                    mem[];
 };
 
+/* smallest region payload, so that a region takes ARENA_DEFAULT_CAPACITY bytes in total */
+#define _ARENA_REGION_MIN                   (ARENA_DEFAULT_CAPACITY - sizeof(struct _memory_region))
+
 struct _arena_alloc_header {
     size_t  size;
     char    mem[];
 };
 
+/* arena flags */
+#define ARENA_CONTIGUOUS                    0x1     /* never append regions, abort when the first one is full */
+#define ARENA_PREFAULT                      0x2     /* fault the pages of new regions in when they are created */
+
 typedef struct _arena {
     size_t                  total;          /* total bytes used by the arena */
+    unsigned                flags;
     struct _memory_region   *head;
     struct _memory_region   *tail;
+    struct _memory_region   *avail;         /* regions searched by arena_alloc, full ones are dropped from it */
+    size_t                  floor;          /* regions before this index are skipped while a mark is taken */
+    struct _arena_handles   *handles;       /* handle table, see arena_handle_alloc */
+#ifdef ARENA_MMAP_BACKEND
+    struct _arena_file      *file;          /* set when the regions live in a file (see arena_file_open) */
+#endif /* ARENA_MMAP_BACKEND */
 } s_arena, p_arena[1];
 
-ARENADEF struct _memory_region *_alloc_memory_region(size_t size, struct _memory_region *next) {
-    struct _memory_region *region = _ARENA_INVALID_ALLOC;
+/*
+ * Self-relative pointers: store the distance from the pointer field to its target, so structures built inside a
+ * contiguous arena remain valid wherever the region ends up mapped (e.g. after arena_load_mmap). 0 means NULL.
+ */
+typedef ptrdiff_t arena_relptr;
+#define arena_relptr_set(rp, ptr)   ((rp) = (ptr) ? (char *)(ptr) - (char *)&(rp) : 0)
+#define arena_relptr_get(rp, type)  ((rp) ? (type *)((char *)&(rp) + (rp)) : (type *)NULL)
+
+/* append a new region to the arena, making it the first one searched for free space */
+ARENADEF void _arena_link_region(p_arena arena, struct _memory_region *region) {
+    region->next = NULL;
+    region->next_avail = arena->avail;
+    region->index = arena->tail ? arena->tail->index + 1 : 0;
+    region->retired = 0;
+    arena->avail = region;
+
+    if (arena->tail) arena->tail->next = region;
+    if (!arena->head) arena->head = region;
+    arena->tail = region;
+}
 
-    if ((region = _ARENA_BACKEND_ALLOC(sizeof(*region) + size)) != _ARENA_INVALID_ALLOC) {
-        region->next = next;
-        region->size = size;
-        region->offset = 0;
-        return region;
+/* rebuild the list of regions searched for free space, after allocations have been released */
+ARENADEF void _arena_relink_avail(p_arena arena) {
+    struct _memory_region *region, **link = &arena->avail;
+    for (region = arena->head; region != NULL; region = region->next) {
+        region->retired = region->size - region->offset < ARENA_RETIRE_THRESHOLD;
+        if (region->retired) continue;
+        *link = region;
+        link = &region->next_avail;
     }
+    *link = NULL;
+}
 
-    _arena_fprintf(stderr, "%s:%d: Failed to allocate %lu bytes\n", __FILE__, __LINE__, sizeof(*region) + size);
-    abort();
+/* put a retired region back in avail once releasing its last blocks has made room in it again */
+ARENADEF void _arena_unretire(p_arena arena, struct _memory_region *region) {
+    if (!region->retired || region->size - region->offset < ARENA_RETIRE_THRESHOLD) return;
+    region->retired = 0;
+    region->next_avail = arena->avail;
+    arena->avail = region;
+}
+
+#ifdef ARENA_MMAP_BACKEND
+ARENADEF size_t _arena_page_size(void) {
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+}
+#endif /* ARENA_MMAP_BACKEND */
+
+/*
+ * Fault in the pages of [addr, addr + size), so the first writes to them don't stall on page faults. The memory
+ * must not hold any data yet, as it may be overwritten with zeros.
+ */
+ARENADEF void *_arena_prefault(void *addr, size_t size) {
+    volatile char *ptr = (volatile char *)addr, *end;
+
+    if (addr == _ARENA_INVALID_ALLOC || size == 0) return addr;
+    end = ptr + size;
+
+#if defined(ARENA_MMAP_BACKEND) && defined(MADV_POPULATE_WRITE)
+    size_t page = _arena_page_size();
+    size_t start = (size_t)addr & ~(page - 1);
+    if (madvise((void *)start, (size_t)end - start, MADV_POPULATE_WRITE) == 0) return addr;
+#endif /* MADV_POPULATE_WRITE */
+
+    /* write to every page (reading first would only map the zero page), 4KB being the smallest page size we expect */
+    for (; ptr < end; ptr += 4096) *ptr = 0;
+    end[-1] = 0;
+
+    return addr;
 }
 
+#ifdef ARENA_MMAP_BACKEND
+/*
+ * File-backed arenas. The file starts with a one-page header followed by the regions, each rounded up to whole
+ * pages and laid out back to back. The whole file is mapped shared into a single reservation, so new regions are
+ * added by extending the file with ftruncate and the data stays at the same offsets from the start of the
+ * mapping across restarts (use arena_relptr for pointers between objects).
+ */
+#define ARENA_FILE_MAGIC                    "ARENAFIL"
+#define ARENA_FILE_RDONLY                   0x1     /* map the file read-only, allocations will abort */
+#define ARENA_FILE_SYNC                     0x2     /* msync(MS_SYNC) the file before closing it */
+#define ARENA_FILE_PREFAULT                 0x4     /* fault the pages of new regions in, as with ARENA_PREFAULT */
+
+#ifndef ARENA_FILE_RESERVE                  /* address space reserved for a file, the maximum file size */
+#define ARENA_FILE_RESERVE                  ((size_t)1 << (sizeof(size_t) > 4 ? 36 : 28))
+#endif /* ARENA_FILE_RESERVE */
+
+struct _arena_file_header {
+    char    magic[8];
+    size_t  header;                         /* sizeof(struct _memory_region) of the writer */
+    size_t  length;                         /* bytes of the file in use (header page and regions) */
+    size_t  root;                           /* offset of the root object, 0 if not set */
+};
+
+struct _arena_file {
+    int     fd;
+    int     flags;
+    char    *base;                          /* where the file is mapped */
+    size_t  reserve;                        /* bytes mapped at base */
+};
+
+ARENADEF void _arena_file_append_region(p_arena arena, size_t size) {
+    struct _arena_file *file = arena->file;
+    struct _arena_file_header *header = (struct _arena_file_header *)file->base;
+    size_t page = _arena_page_size();
+    size_t bytes = (sizeof(struct _memory_region) + size + page - 1) & ~(page - 1);
+
+    if (file->flags & ARENA_FILE_RDONLY) {
+        _arena_fprintf(stderr, "%s:%d: Cannot allocate from a read-only file arena\n", __FILE__, __LINE__);
+        abort();
+    }
+
+    if (header->length + bytes > file->reserve || ftruncate(file->fd, (off_t)(header->length + bytes)) != 0) {
+        _arena_fprintf(stderr, "%s:%d: Failed to extend file arena by %lu bytes\n", __FILE__, __LINE__, bytes);
+        abort();
+    }
+
+    struct _memory_region *region = (struct _memory_region *)(file->base + header->length);
+    region->size = bytes - sizeof(*region);
+    region->offset = 0;
+
+    if (arena->flags & ARENA_PREFAULT) _arena_prefault(region->mem, region->size);
+    _arena_link_region(arena, region);
+    arena->total += bytes;
+    header->length += bytes;
+}
+
+ARENADEF void _arena_file_close(p_arena arena) {
+    struct _arena_file *file = arena->file;
+    if (file->flags & ARENA_FILE_SYNC) {
+        msync(file->base, ((struct _arena_file_header *)file->base)->length, MS_SYNC);
+    }
+    munmap(file->base, file->reserve);
+    close(file->fd);
+    free(file);
+    arena->file = NULL;
+}
+
+/*
+ * Open (or create) the file arena at `path` in `arena`, which must be empty. Existing regions are mapped back
+ * with their contents, and new allocations extend the file. With ARENA_FILE_RDONLY the file is only mapped for
+ * reading (it can be shared with a writer) and its data is reached through arena_file_root.
+ * Returns 0 on success and -1 on failure (with errno set).
+ */
+ARENADEF int arena_file_open(p_arena arena, const char *path, int flags) {
+    struct _arena_file_header header;
+    struct stat st;
+    size_t page = _arena_page_size(), reserve = 0;
+    char *base = (char *)MAP_FAILED;
+    int rdonly = flags & ARENA_FILE_RDONLY, error = 0;
+    int fd = open(path, rdonly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) return -1;
+
+    if (fstat(fd, &st) != 0) {
+        error = errno;
+    } else if (st.st_size == 0 && !rdonly) {
+        memcpy(header.magic, ARENA_FILE_MAGIC, sizeof(header.magic));
+        header.header = sizeof(struct _memory_region);
+        header.length = page;
+        header.root = 0;
+        if (ftruncate(fd, (off_t)page) != 0 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) error = errno;
+    } else if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+               memcmp(header.magic, ARENA_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+               header.header != sizeof(struct _memory_region) ||
+               header.length < page || header.length > (size_t)st.st_size) {
+        error = EINVAL;
+    }
+
+    if (!error) {
+        reserve = rdonly ? header.length : ARENA_FILE_RESERVE;
+        if (reserve < header.length) {
+            error = EFBIG;
+        } else if ((base = (char *)mmap(NULL, reserve, rdonly ? PROT_READ : PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            error = errno;
+        }
+    }
+
+    /* relink the regions, their next pointers are only meaningful for the mapping that wrote them */
+    arena->head = arena->tail = arena->avail = NULL;
+    arena->total = 0;
+    if (!error && !rdonly) {
+        size_t offset = page;
+        while (offset < header.length) {
+            struct _memory_region *region = (struct _memory_region *)(base + offset);
+            if (header.length - offset < sizeof(*region) || region->size > header.length - offset - sizeof(*region) ||
+                region->offset > region->size) {
+                error = EINVAL;
+                break;
+            }
+            _arena_link_region(arena, region);
+            offset += sizeof(*region) + region->size;
+        }
+        arena->total = header.length - page;
+        _arena_relink_avail(arena);
+    }
+
+    if (!error && (arena->file = (struct _arena_file *)malloc(sizeof(*arena->file))) == NULL) error = ENOMEM;
+
+    if (error) {
+        if (base != MAP_FAILED) munmap(base, reserve);
+        close(fd);
+        arena->head = arena->tail = arena->avail = NULL;
+        arena->total = 0;
+        errno = error;
+        return -1;
+    }
+
+    arena->file->fd = fd;
+    arena->file->flags = flags;
+    arena->file->base = base;
+    arena->file->reserve = reserve;
+    arena->flags = (flags & ARENA_FILE_PREFAULT) ? ARENA_PREFAULT : 0;
+    return 0;
+}
+
+/* Flush the file arena to disk, waiting for the write to complete unless `async` is set */
+ARENADEF int arena_file_sync(p_arena arena, int async) {
+    struct _arena_file *file = arena->file;
+    return msync(file->base, ((struct _arena_file_header *)file->base)->length, async ? MS_ASYNC : MS_SYNC);
+}
+
+/* Record `ptr` (allocated from the file arena) as the entry point to its data */
+ARENADEF void arena_file_set_root(p_arena arena, void *ptr) {
+    ((struct _arena_file_header *)arena->file->base)->root = ptr ? (size_t)((char *)ptr - arena->file->base) : 0;
+}
+
+ARENADEF void *arena_file_root(p_arena arena) {
+    size_t root = ((struct _arena_file_header *)arena->file->base)->root;
+    return root ? arena->file->base + root : NULL;
+}
+#endif /* ARENA_MMAP_BACKEND */
+
 ARENADEF void _arena_append_region(p_arena arena, size_t size) {
-    struct _memory_region *region = _ARENA_INVALID_ALLOC;
+    struct _memory_region *region = NULL;
+
+#ifdef ARENA_MMAP_BACKEND
+    if (arena->file) {
+        _arena_file_append_region(arena, size);
+        _ARENA_TRACE(region, arena, arena->tail, arena->tail->size, arena->total);
+        return;
+    }
+#endif /* ARENA_MMAP_BACKEND */
+
+    /* round up to whole pages, the backend would waste the rest of the last one anyway */
+    size = ((sizeof(*region) + size + ARENA_PAGE_SIZE - 1) & ~((size_t)ARENA_PAGE_SIZE - 1)) - sizeof(*region);
+
+    if (arena->flags & ARENA_PREFAULT) region = (struct _memory_region *)_ARENA_BACKEND_ALLOC_POPULATED(sizeof(*region) + size);
+    else region = (struct _memory_region *)_ARENA_BACKEND_ALLOC(sizeof(*region) + size);
 
-    if ((region = _ARENA_BACKEND_ALLOC(sizeof(*region) + size)) == _ARENA_INVALID_ALLOC) {
+    if (region == _ARENA_INVALID_ALLOC) {
         _arena_fprintf(stderr, "%s:%d: Failed to allocate %lu bytes\n", __FILE__, __LINE__, sizeof(*region) + size);
         abort();
     }
 
-    region->next = NULL;
     region->size = size;
     region->offset = 0;
 
-    if (arena->tail) arena->tail->next = region;
-    if (!arena->head) arena->head = region;
-
-    arena->tail = region;
+    _arena_link_region(arena, region);
     arena->total += sizeof(*arena->tail) + arena->tail->size;
+    _ARENA_TRACE(region, arena, region, region->size, arena->total);
 }
 
 ARENADEF void arena_init(p_arena arena) {
     arena->total = 0;
-    _arena_append_region(arena, ARENA_DEFAULT_CAPACITY);
+    _arena_append_region(arena, _ARENA_REGION_MIN);
+}
+
+ARENADEF void arena_init_flags(p_arena arena, unsigned flags) {
+    arena->flags = flags;
+    arena_init(arena);
 }
 
 ARENADEF void arena_deinit(p_arena arena) {
     struct _memory_region *next = arena->head;
+    _ARENA_TRACE(deinit, arena, NULL, arena->total, 0);
+#ifdef ARENA_MMAP_BACKEND
+    if (arena->file) {
+        _arena_file_close(arena);
+        next = NULL;
+    }
+#endif /* ARENA_MMAP_BACKEND */
     while (next != NULL) {
         struct _memory_region *region = next;
         next = region->next;
         _ARENA_BACKEND_DEALLOC(region, sizeof(*region) + region->size);
     }
+    free(arena->handles);
+    arena->handles = NULL;
     arena->total = 0;
+    arena->flags = 0;
+    arena->floor = 0;
+    arena->head = NULL;
+    arena->tail = NULL;
+    arena->avail = NULL;
 }
 
-ARENADEF void *arena_alloc(p_arena arena, size_t size) {
-    if (arena->tail == NULL) arena_init(arena);
+/* Initialize an arena made of a single region of `capacity` bytes, which is never extended */
+ARENADEF void arena_init_contiguous(p_arena arena, size_t capacity) {
+    arena->total = 0;
+    arena->flags |= ARENA_CONTIGUOUS;
+    _arena_append_region(arena, capacity);
+}
 
-    size_t required = sizeof(struct _arena_alloc_header) + size;
+/* The first object allocated in the arena, used as the entry point of contiguous arenas */
+ARENADEF void *arena_root(p_arena arena) {
+    if (arena->head == NULL || arena->head->offset == 0) return NULL;
+    return ((struct _arena_alloc_header *)arena->head->mem)->mem;
+}
+
+/* position of an arena, to be restored with arena_rewind */
+typedef struct _arena_mark {
+    struct _memory_region   *region;        /* last region of the arena when the mark was taken */
+    size_t                  offset;
+    size_t                  floor;          /* floor of the arena before the mark, restored by arena_rewind */
+} s_arena_mark;
+
+/*
+ * Move the offset of `region` back to `offset`. Once regions totalling ARENA_RETAIN_SIZE bytes have been kept
+ * (counted in `kept`), the pages of the released span are given back to the OS with madvise, keeping the
+ * mapping, so a spike doesn't pin the peak RSS forever. The malloc backend has no way to do that.
+ */
+ARENADEF void _arena_rewind_region(struct _memory_region *region, size_t offset, size_t *kept) {
+    *kept += sizeof(*region) + region->size;
+#ifdef ARENA_MMAP_BACKEND
+    if (*kept > ARENA_RETAIN_SIZE && offset < region->offset) {
+        size_t page = _arena_page_size();
+        size_t start = ((size_t)(region->mem + offset) + page - 1) & ~(page - 1);
+        size_t end = ((size_t)(region->mem + region->offset) + page - 1) & ~(page - 1);
+        if (start < end) _ARENA_BACKEND_RELEASE((void *)start, end - start);
+    }
+#endif /* ARENA_MMAP_BACKEND */
+    region->offset = offset;
+}
+
+/* Discard every allocation, keeping the regions for reuse */
+ARENADEF void arena_reset(p_arena arena) {
+    size_t kept = 0;
+    struct _memory_region *region;
+    for (region = arena->head; region != NULL; region = region->next) _arena_rewind_region(region, 0, &kept);
+    arena->floor = 0;
+    _arena_relink_avail(arena);
+}
+
+/*
+ * Until it is rewound to, a mark keeps allocations out of the free space of the regions before the last one, so
+ * everything allocated after it lands in memory that arena_rewind releases. Marks nest, and a mark that is never
+ * rewound to only leaves that free space unused until the next arena_reset.
+ */
+ARENADEF s_arena_mark arena_mark(p_arena arena) {
+    s_arena_mark mark = { arena->tail, arena->tail ? arena->tail->offset : 0, arena->floor };
+    if (arena->tail) arena->floor = arena->tail->index;
+    return mark;
+}
+
+/* Discard every allocation made since `mark` was taken */
+ARENADEF void arena_rewind(p_arena arena, s_arena_mark mark) {
+    size_t kept = 0;
     struct _memory_region *region = arena->head;
 
-    while (region) {
-        if (required <= region->size - region->offset) break;
-        region = region->next;
+    if (mark.region == NULL) {
+        arena_reset(arena);
+        arena->floor = mark.floor;
+        return;
+    }
+
+    for (; region != mark.region; region = region->next) kept += sizeof(*region) + region->size;
+    if (mark.offset < region->offset) _arena_rewind_region(region, mark.offset, &kept);
+    else kept += sizeof(*region) + region->size;
+    for (region = region->next; region != NULL; region = region->next) _arena_rewind_region(region, 0, &kept);
+    arena->floor = mark.floor;
+    _arena_relink_avail(arena);
+}
+
+/* find (or append) a region with at least `required` free bytes */
+ARENADEF struct _memory_region *_arena_reserve(p_arena arena, size_t required) {
+    if (arena->tail == NULL) arena_init(arena);
+
+    struct _memory_region *region, **link = &arena->avail;
+
+    while ((region = *link) != NULL) {
+        size_t available = region->size - region->offset;
+        if (region->index < arena->floor) {
+            /* allocated from, it could not be rewound */
+            link = &region->next_avail;
+            continue;
+        }
+        if (required <= available) break;
+        /* regions that can't hold anything meaningful anymore are only reachable through head from now on */
+        if (available < ARENA_RETIRE_THRESHOLD) {
+            region->retired = 1;
+            *link = region->next_avail;
+        } else {
+            link = &region->next_avail;
+        }
     }
 
     if (region == NULL) {
-        _arena_append_region(arena, required > ARENA_DEFAULT_CAPACITY ? required : ARENA_DEFAULT_CAPACITY);
+        if (arena->flags & ARENA_CONTIGUOUS) {
+            _arena_fprintf(stderr, "%s:%d: Contiguous arena exhausted while allocating %lu bytes\n", __FILE__, __LINE__, required);
+            abort();
+        }
+        _arena_append_region(arena, required > _ARENA_REGION_MIN ? required : _ARENA_REGION_MIN);
         region = arena->tail;
     }
 
-    struct _arena_alloc_header *header = (void *)((char *)region->mem + region->offset);
+    return region;
+}
+
+/*
+ * Make sure the next `size` bytes of allocations are served from memory that is already faulted in, moving the
+ * page fault cost out of latency-sensitive paths (e.g. call it between requests).
+ */
+ARENADEF void arena_prefault(p_arena arena, size_t size) {
+    struct _memory_region *region = _arena_reserve(arena, size);
+    _arena_prefault(region->mem + region->offset, size);
+}
+
+ARENADEF void *arena_alloc(p_arena arena, size_t size) {
+    size_t required = sizeof(struct _arena_alloc_header) + size;
+    struct _memory_region *region = _arena_reserve(arena, required);
+
+    struct _arena_alloc_header *header = (struct _arena_alloc_header *)((char *)region->mem + region->offset);
     header->size = size;
     region->offset += required;
 
+    _ARENA_TRACE(alloc, arena, header->mem, size, 0);
+    return header->mem;
+}
+
+/* bytes to skip at `at` so that the data of a block placed after them is aligned to `align` */
+ARENADEF size_t _arena_align_pad(const char *at, size_t align) {
+    size_t pad = (align - ((size_t)at + sizeof(struct _arena_alloc_header)) % align) % align;
+    /* the skipped bytes must hold the header of a filler block */
+    while (pad != 0 && pad < sizeof(struct _arena_alloc_header)) pad += align;
+    return pad;
+}
+
+/* a block that is never used, taking `pad` bytes, so the blocks of a region can still be walked over it */
+ARENADEF void _arena_fill(char *at, size_t pad) {
+    /* `at` follows whatever was allocated last, so it may be misaligned itself */
+    size_t size = pad - sizeof(struct _arena_alloc_header);
+    memcpy(at, &size, sizeof(size));
+    if (size >= sizeof(size_t)) memset(at + sizeof(struct _arena_alloc_header), 0, sizeof(size_t)); /* not a live handle, see arena_compact */
+}
+
+/*
+ * Allocate `size` bytes aligned to `align` (a power of 2). arena_alloc places a block right after the previous
+ * one, so its alignment depends on the sizes allocated before it; here a filler block is put in front when
+ * needed. The result can be passed to arena_free like any other block.
+ */
+ARENADEF void *arena_alloc_aligned(p_arena arena, size_t size, size_t align) {
+    /* the header in front of the data is aligned along with it */
+    if (align < __alignof__(struct _arena_alloc_header)) align = __alignof__(struct _arena_alloc_header);
+    size_t required = 2 * sizeof(struct _arena_alloc_header) + align + size;
+    struct _memory_region *region = _arena_reserve(arena, required);
+    size_t pad = _arena_align_pad(region->mem + region->offset, align);
+
+    if (pad != 0) _arena_fill(region->mem + region->offset, pad);
+    struct _arena_alloc_header *header = (struct _arena_alloc_header *)(region->mem + region->offset + pad);
+    header->size = size;
+    region->offset += pad + sizeof(*header) + size;
+
+    _ARENA_TRACE(alloc, arena, header->mem, size, align);
     return header->mem;
 }
 
+/*
+ * Allocate `count` objects of `size` bytes each, storing their addresses in `ptrs`. The space for all of them is
+ * reserved with a single region search, but every object keeps its own header, so each one can still be passed
+ * to arena_free/arena_realloc individually.
+ */
+ARENADEF void arena_alloc_many(p_arena arena, size_t count, size_t size, void **ptrs) {
+    if (count == 0) return;
+
+    size_t stride = sizeof(struct _arena_alloc_header) + size;
+    if (stride < size || count > (size_t)-1 / stride) {
+        _arena_fprintf(stderr, "%s:%d: Allocation of %lu objects of %lu bytes overflows\n", __FILE__, __LINE__, count, size);
+        abort();
+    }
+
+    struct _memory_region *region = _arena_reserve(arena, count * stride);
+    char *cursor = region->mem + region->offset;
+    size_t i;
+
+    for (i = 0; i < count; i ++) {
+        struct _arena_alloc_header *header = (struct _arena_alloc_header *)cursor;
+        header->size = size;
+        ptrs[i] = header->mem;
+        cursor += stride;
+    }
+
+    region->offset += count * stride;
+    _ARENA_TRACE(alloc_many, arena, ptrs, size, count);
+}
+
+/* Allocate a single contiguous array of `count` objects of `size` bytes each (one header for the whole array) */
+ARENADEF void *arena_alloc_array(p_arena arena, size_t count, size_t size) {
+    if (size != 0 && count > (size_t)-1 / size) {
+        _arena_fprintf(stderr, "%s:%d: Allocation of %lu objects of %lu bytes overflows\n", __FILE__, __LINE__, count, size);
+        abort();
+    }
+    return arena_alloc(arena, count * size);
+}
+
 ARENADEF struct _memory_region * _arena_find_region(p_arena arena, void *ptr) {
-    struct _arena_alloc_header *header = (void *)((char *)ptr - sizeof(*header));
+    struct _arena_alloc_header *header = (struct _arena_alloc_header *)((char *)ptr - sizeof(*header));
     char *endptr = header->mem + header->size;
-    struct _memory_region *region = arena->head;
+    struct _memory_region *region = arena->avail;
+
+    /* most of the time it is the region allocations are currently being served from */
+    if (region && (char *)ptr >= region->mem && endptr <= region->mem + region->offset) return region;
+
+    region = arena->head;
     while (region) {
         if ((char *)ptr >= region->mem && endptr <= region->mem + region->offset) {
             return region;
@@ -155,36 +692,701 @@ ARENADEF struct _memory_region * _arena_find_region(p_arena arena, void *ptr) {
 
 ARENADEF void arena_free(p_arena arena, void *ptr) {
     if (!ptr) return;
-    struct _arena_alloc_header *header = (void *)((char *)ptr - sizeof(*header));
+    struct _arena_alloc_header *header = (struct _arena_alloc_header *)((char *)ptr - sizeof(*header));
     struct _memory_region *region = _arena_find_region(arena, ptr);
+    _ARENA_TRACE(free, arena, ptr, header->size, 0);
     if (header->mem + header->size == region->mem + region->offset) {
-        region->offset -= header->size - sizeof(*header);
+        region->offset -= header->size + sizeof(*header);
+        _arena_unretire(arena, region);
+    }
+}
+
+#ifdef _ARENA_STREAM_COPY
+ARENADEF void _arena_stream_sse2(char *dst, const char *src, size_t size) {
+    size_t head = (16 - ((size_t)dst & 15)) & 15;
+
+    if (head > size) head = size;               /* ARENA_STREAM_THRESHOLD can be set below a vector */
+    memcpy(dst, src, head);
+    dst += head, src += head, size -= head;
+
+    for (; size >= 64; size -= 64, dst += 64, src += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+        _mm_stream_si128((__m128i *)dst, a);
+        _mm_stream_si128((__m128i *)(dst + 16), b);
+        _mm_stream_si128((__m128i *)(dst + 32), c);
+        _mm_stream_si128((__m128i *)(dst + 48), d);
+    }
+
+    _mm_sfence();
+    memcpy(dst, src, size);
+}
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define _ARENA_STREAM_AVX2 __attribute__((target("avx2")))
+#else
+#define _ARENA_STREAM_AVX2
+#endif
+
+#if defined(__GNUC__) || defined(__AVX2__)
+ARENADEF _ARENA_STREAM_AVX2 void _arena_stream_avx2(char *dst, const char *src, size_t size) {
+    size_t head = (32 - ((size_t)dst & 31)) & 31;
+
+    if (head > size) head = size;               /* ARENA_STREAM_THRESHOLD can be set below a vector */
+    memcpy(dst, src, head);
+    dst += head, src += head, size -= head;
+
+    for (; size >= 128; size -= 128, dst += 128, src += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+        _mm256_stream_si256((__m256i *)dst, a);
+        _mm256_stream_si256((__m256i *)(dst + 32), b);
+        _mm256_stream_si256((__m256i *)(dst + 64), c);
+        _mm256_stream_si256((__m256i *)(dst + 96), d);
     }
+
+    _mm_sfence();
+    memcpy(dst, src, size);
+}
+#endif /* __GNUC__ || __AVX2__ */
+#endif /* _ARENA_STREAM_COPY */
+
+/*
+ * memcpy for arena copies. Copies of ARENA_STREAM_THRESHOLD bytes or more use non-temporal stores (AVX2 when the
+ * CPU has it, SSE2 otherwise), so cloning a large payload doesn't evict the caller's working set from the cache.
+ */
+ARENADEF void *_arena_copy(void *dst, const void *src, size_t size) {
+#ifdef _ARENA_STREAM_COPY
+    if (size >= ARENA_STREAM_THRESHOLD) {
+#if defined(__AVX2__)
+        _arena_stream_avx2((char *)dst, (const char *)src, size);
+#elif defined(__GNUC__)
+        if (__builtin_cpu_supports("avx2")) _arena_stream_avx2((char *)dst, (const char *)src, size);
+        else _arena_stream_sse2((char *)dst, (const char *)src, size);
+#else
+        _arena_stream_sse2((char *)dst, (const char *)src, size);
+#endif
+        return dst;
+    }
+#endif /* _ARENA_STREAM_COPY */
+    return memcpy(dst, src, size);
 }
 
 ARENADEF void *arena_realloc(p_arena arena, void *ptr, size_t size) {
     if (ptr == NULL) return arena_alloc(arena, size);
 
-    struct _arena_alloc_header *header = (void *)((char *)ptr - sizeof(*header));
+    struct _arena_alloc_header *header = (struct _arena_alloc_header *)((char *)ptr - sizeof(*header));
+    struct _memory_region *region = _arena_find_region(arena, ptr);
+    int last = header->mem + header->size == region->mem + region->offset;
 
+    /* shrinking the last block of a region gives the tail back to it */
     if (size <= header->size) {
+        if (last) {
+            region->offset -= header->size - size;
+            _arena_unretire(arena, region);
+        }
         header->size = size;
+        _ARENA_TRACE(realloc, arena, ptr, size, ptr);
         return header->mem;
     }
 
+    /* so does freeing (or rewinding past) the blocks after it, which lets it grow in place */
     size_t required = size - header->size;
-    char *endptr = header->mem + header->size;
-
-    struct _memory_region *region = _arena_find_region(arena, ptr);
-    if (endptr == region->mem + region->offset && required <= (region->size - region->offset)) {
+    if (last && required <= (region->size - region->offset)) {
         header->size = size;
         region->offset += required;
+        _ARENA_TRACE(realloc, arena, ptr, size, ptr);
         return header->mem;
     }
 
-    return memcpy(arena_alloc(arena, size), header->mem, header->size);
+    /* the new block can't land in this region (it didn't fit even in place), so the old one can be released */
+    void *moved = _arena_copy(arena_alloc(arena, size), header->mem, header->size);
+    if (last) {
+        region->offset -= sizeof(*header) + header->size;
+        _arena_unretire(arena, region);
+    }
+    _ARENA_TRACE(realloc, arena, moved, size, ptr);
+    return moved;
+}
+
+#define arena_memclone(arena, ptr, size) _arena_copy(arena_alloc((arena), (size)), (ptr), (size))
+
+/*
+ * Relocatable allocations. A handle names a block through the arena's handle table instead of by address, so
+ * arena_compact can slide the live blocks together, closing the holes left by arena_handle_free, and release the
+ * regions left empty at the end. Each block starts with the handle that owns it, which is how compaction tells
+ * live blocks from dead ones. Addresses returned by arena_handle_deref are invalidated by arena_compact.
+ */
+typedef size_t arena_handle;                /* 0 is never a valid handle */
+
+struct _arena_handle_entry {
+    void    *ptr;                           /* the block's data, NULL when the handle is free */
+    size_t  next;                           /* next free handle */
+};
+
+struct _arena_handles {
+    size_t  capacity;
+    size_t  count;                          /* entries ever used */
+    size_t  free;                           /* first free handle, 0 if none */
+    struct _arena_handle_entry items[];
+};
+
+ARENADEF arena_handle arena_handle_alloc(p_arena arena, size_t size) {
+    struct _arena_handles *table = arena->handles;
+    arena_handle handle;
+
+    if (table && table->free) {
+        handle = table->free;
+        table->free = table->items[handle - 1].next;
+    } else {
+        if (table == NULL || table->count == table->capacity) {
+            size_t capacity = table ? table->capacity * 2 : 64;
+            table = (struct _arena_handles *)realloc(table, sizeof(*table) + capacity * sizeof(table->items[0]));
+            if (table == NULL) {
+                _arena_fprintf(stderr, "%s:%d: Failed to grow the handle table to %lu entries\n", __FILE__, __LINE__, capacity);
+                abort();
+            }
+            if (arena->handles == NULL) table->count = table->free = 0;
+            table->capacity = capacity;
+            arena->handles = table;
+        }
+        handle = ++ table->count;
+    }
+
+    /* the handle takes a whole alignment unit, so the data after it is aligned too */
+    size = (size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    size_t *block = (size_t *)arena_alloc_aligned(arena, ARENA_HANDLE_ALIGN + size, ARENA_HANDLE_ALIGN);
+    *block = handle;
+    table->items[handle - 1].ptr = (char *)block + ARENA_HANDLE_ALIGN;
+    return handle;
+}
+
+ARENADEF void *arena_handle_deref(p_arena arena, arena_handle handle) {
+    return arena->handles->items[handle - 1].ptr;
+}
+
+ARENADEF void arena_handle_free(p_arena arena, arena_handle handle) {
+    struct _arena_handles *table = arena->handles;
+    size_t *block = (size_t *)((char *)table->items[handle - 1].ptr - ARENA_HANDLE_ALIGN);
+
+    *block = 0;
+    arena_free(arena, block);
+    table->items[handle - 1].ptr = NULL;
+    table->items[handle - 1].next = table->free;
+    table->free = handle;
+}
+
+/*
+ * Move every live handle block towards the start of the arena and free the regions left empty after them (file
+ * arenas keep them, emptied). Only valid when every allocation in the arena was made with arena_handle_alloc.
+ */
+ARENADEF void arena_compact(p_arena arena) {
+    struct _arena_handles *table = arena->handles;
+    struct _memory_region *region, *cursor = arena->head, *next;
+    size_t offset = 0;
+
+    if (table == NULL || cursor == NULL) return;
+
+    for (region = arena->head; region != NULL; region = region->next) {
+        size_t position = 0;
+        while (position < region->offset) {
+            struct _arena_alloc_header *header = (struct _arena_alloc_header *)(region->mem + position);
+            size_t length = sizeof(*header) + header->size;
+            size_t handle = header->size >= sizeof(size_t) ? *(size_t *)header->mem : 0; /* fillers are 0 */
+            position += length;
+
+            if (handle == 0 || table->items[handle - 1].ptr != header->mem + ARENA_HANDLE_ALIGN) continue;
+
+            /*
+             * Blocks only move backwards, so the cursor never passes the region being scanned. Block sizes are
+             * multiples of sizeof(size_t), so the padding that keeps the block aligned never takes it past
+             * where it already is.
+             */
+            size_t pad = _arena_align_pad(cursor->mem + offset, ARENA_HANDLE_ALIGN);
+            while (offset + pad + length > cursor->size) {
+                cursor->offset = offset;
+                cursor = cursor->next;
+                offset = 0;
+                pad = _arena_align_pad(cursor->mem, ARENA_HANDLE_ALIGN);
+            }
+
+            if (pad != 0) _arena_fill(cursor->mem + offset, pad);
+            offset += pad;
+            memmove(cursor->mem + offset, header, length);
+            table->items[handle - 1].ptr = ((struct _arena_alloc_header *)(cursor->mem + offset))->mem + ARENA_HANDLE_ALIGN;
+            offset += length;
+        }
+    }
+    cursor->offset = offset;
+
+#ifdef ARENA_MMAP_BACKEND
+    if (arena->file) {
+        for (region = cursor->next; region != NULL; region = region->next) region->offset = 0;
+        _arena_relink_avail(arena);
+        return;
+    }
+#endif /* ARENA_MMAP_BACKEND */
+
+    for (region = cursor->next; region != NULL; region = next) {
+        next = region->next;
+        arena->total -= sizeof(*region) + region->size;
+        _ARENA_BACKEND_DEALLOC(region, sizeof(*region) + region->size);
+    }
+    cursor->next = NULL;
+    arena->tail = cursor;
+    if (arena->floor > cursor->index) arena->floor = cursor->index;
+    _arena_relink_avail(arena);
+}
+
+/*
+ * Epoch-based reclamation of whole arenas. A single writer (or writers serialized by the caller) builds each new
+ * version of a read-mostly structure in a fresh arena from arena_epoch_begin and publishes it atomically with
+ * arena_epoch_publish. Readers bracket their accesses with arena_epoch_enter/arena_epoch_leave, which never block
+ * or write shared state other than their own slot, and an older arena is only passed to arena_deinit once every
+ * reader that could have seen it has left.
+ */
+#ifndef ARENA_EPOCH_MAX_READERS
+#define ARENA_EPOCH_MAX_READERS             64
+#endif /* ARENA_EPOCH_MAX_READERS */
+
+/* each reader slot gets its own cache line, so readers don't contend with each other */
+struct _arena_epoch_slot {
+    size_t                  epoch;          /* epoch the reader entered at, 0 when outside */
+    char                    pad[ARENA_CACHELINE - sizeof(size_t)];
+};
+
+struct _arena_epoch_version {
+    s_arena                 arena;          /* must be the first member */
+    size_t                  epoch;          /* readers that entered before this epoch may still use the arena */
+    struct _arena_epoch_version *next;
+};
+
+typedef struct _arena_epoch {
+    struct _arena_epoch_slot    slots[ARENA_EPOCH_MAX_READERS];
+    size_t                      epoch;      /* global epoch, starting at 1 */
+    size_t                      readers;    /* registered reader slots */
+    void                        *current;   /* root of the published version */
+    struct _arena_epoch_version *version;   /* arena holding the published version */
+    struct _arena_epoch_version *retired;   /* older versions waiting for their readers */
+} s_arena_epoch, p_arena_epoch[1];
+
+ARENADEF void arena_epoch_init(p_arena_epoch es) {
+    memset(es, 0, sizeof(*es));
+    es->epoch = 1;
+}
+
+/* Claim a reader slot, to be passed to arena_epoch_enter/arena_epoch_leave by a single thread */
+ARENADEF size_t arena_epoch_register(p_arena_epoch es) {
+    size_t slot = __atomic_fetch_add(&es->readers, 1, __ATOMIC_RELAXED);
+    if (slot >= ARENA_EPOCH_MAX_READERS) {
+        _arena_fprintf(stderr, "%s:%d: More than %d arena epoch readers\n", __FILE__, __LINE__, ARENA_EPOCH_MAX_READERS);
+        abort();
+    }
+    return slot;
+}
+
+/* Enter the current epoch and return the published root, which stays valid until arena_epoch_leave */
+ARENADEF void *arena_epoch_enter(p_arena_epoch es, size_t slot) {
+    size_t epoch = __atomic_load_n(&es->epoch, __ATOMIC_ACQUIRE);
+    /* the slot must be visible before the root is read, pairs with the writer publishing and then scanning slots */
+    __atomic_store_n(&es->slots[slot].epoch, epoch, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&es->current, __ATOMIC_SEQ_CST);
+}
+
+ARENADEF void arena_epoch_leave(p_arena_epoch es, size_t slot) {
+    __atomic_store_n(&es->slots[slot].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Create an empty arena to build the next version in */
+ARENADEF s_arena *arena_epoch_begin(p_arena_epoch es) {
+    struct _arena_epoch_version *version = (struct _arena_epoch_version *)calloc(1, sizeof(*version));
+    (void)es;
+    if (version == NULL) {
+        _arena_fprintf(stderr, "%s:%d: Failed to allocate %lu bytes\n", __FILE__, __LINE__, sizeof(*version));
+        abort();
+    }
+    arena_init(&version->arena);
+    return &version->arena;
+}
+
+/* Release the retired arenas that no reader can be using anymore */
+ARENADEF void arena_epoch_reclaim(p_arena_epoch es) {
+    struct _arena_epoch_version **link = &es->retired, *version;
+    size_t i, oldest = (size_t)-1;
+
+    for (i = 0; i < ARENA_EPOCH_MAX_READERS; i ++) {
+        size_t epoch = __atomic_load_n(&es->slots[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+
+    while ((version = *link) != NULL) {
+        if (version->epoch <= oldest) {
+            *link = version->next;
+            arena_deinit(&version->arena);
+            free(version);
+        } else {
+            link = &version->next;
+        }
+    }
+}
+
+/*
+ * Publish `root`, allocated in `arena` (from arena_epoch_begin), as the new version. The previous version's arena
+ * is retired and released as soon as its last reader leaves.
+ */
+ARENADEF void arena_epoch_publish(p_arena_epoch es, s_arena *arena, void *root) {
+    struct _arena_epoch_version *old = es->version;
+
+    __atomic_store_n(&es->current, root, __ATOMIC_SEQ_CST);
+    es->version = (struct _arena_epoch_version *)arena;
+
+    /* readers entering from now on get the new root, older ones may still hold the previous one */
+    size_t epoch = __atomic_add_fetch(&es->epoch, 1, __ATOMIC_SEQ_CST);
+    if (old != NULL) {
+        old->epoch = epoch;
+        old->next = es->retired;
+        es->retired = old;
+    }
+
+    arena_epoch_reclaim(es);
+}
+
+/* Release every version, once all readers are gone */
+ARENADEF void arena_epoch_deinit(p_arena_epoch es) {
+    struct _arena_epoch_version *version = es->retired;
+
+    if (es->version) {
+        es->version->next = es->retired;
+        version = es->version;
+    }
+
+    while (version != NULL) {
+        struct _arena_epoch_version *next = version->next;
+        arena_deinit(&version->arena);
+        free(version);
+        version = next;
+    }
+
+    es->retired = es->version = NULL;
+    es->current = NULL;
+}
+
+/*
+ * Handoff of whole arenas between threads. A producer builds a batch in an arena and pushes it, which moves the
+ * arena (regions, handles and all) into the queue and leaves the producer's one empty; the consumer pops it into
+ * an empty arena of its own, reads it, and releases it with arena_deinit. Nothing is copied or freed per object.
+ * The queue is lock-free with any number of producers and a single consumer, and needs no allocation: each
+ * queue node is allocated in the arena it carries.
+ */
+struct _arena_batch {
+    struct _arena_batch     *next;
+    s_arena                 arena;
+};
+
+typedef struct _arena_queue {
+    struct _arena_batch     *head;          /* last pushed batch, written by producers */
+    char                    pad[ARENA_CACHELINE - sizeof(void *)];
+    struct _arena_batch     *tail;          /* next batch to pop, owned by the consumer */
+    struct _arena_batch     stub;
+} s_arena_queue, p_arena_queue[1];
+
+ARENADEF void arena_queue_init(p_arena_queue queue) {
+    memset(queue, 0, sizeof(*queue));
+    queue->head = queue->tail = &queue->stub;
+}
+
+ARENADEF void _arena_queue_link(p_arena_queue queue, struct _arena_batch *batch) {
+    __atomic_store_n(&batch->next, NULL, __ATOMIC_RELAXED);
+    struct _arena_batch *prev = __atomic_exchange_n(&queue->head, batch, __ATOMIC_ACQ_REL);
+    /* publishes the batch and everything written to its arena */
+    __atomic_store_n(&prev->next, batch, __ATOMIC_RELEASE);
+}
+
+/* Move `arena` into the queue, leaving it empty */
+ARENADEF void arena_queue_push(p_arena_queue queue, p_arena arena) {
+    /* the atomics on batch->next need it naturally aligned */
+    struct _arena_batch *batch = (struct _arena_batch *)arena_alloc_aligned(arena, sizeof(*batch), __alignof__(struct _arena_batch));
+    batch->arena = *arena;
+    memset(arena, 0, sizeof(*arena));
+    _arena_queue_link(queue, batch);
+}
+
+ARENADEF void _arena_queue_take(struct _arena_batch *batch, p_arena arena) {
+    *arena = batch->arena;
+    arena_free(arena, batch);
+}
+
+/*
+ * Move the oldest batch into `arena`, which must be empty. Returns 1 if there was one, 0 if the queue is empty
+ * (or a producer is still in the middle of pushing the next batch). Only one thread may pop from a queue.
+ */
+ARENADEF int arena_queue_pop(p_arena_queue queue, p_arena arena) {
+    struct _arena_batch *tail = queue->tail;
+    struct _arena_batch *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->stub) {
+        if (next == NULL) return 0;
+        queue->tail = tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next == NULL) {
+        /* tail is the last batch, put the stub behind it so it can be taken out of the list */
+        if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) return 0;
+        _arena_queue_link(queue, &queue->stub);
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        if (next == NULL) return 0;
+    }
+
+    queue->tail = next;
+    _arena_queue_take(tail, arena);
+    return 1;
+}
+
+#ifdef ARENA_MMAP_BACKEND
+/*
+ * Snapshots of contiguous arenas. The file holds one page with a small header followed by the image of the
+ * region (its header and the used part of mem[]), so it can be mapped back page-aligned without copying.
+ */
+#define ARENA_SNAPSHOT_MAGIC                "ARENASNP"
+
+struct _arena_snapshot_header {
+    char    magic[8];
+    size_t  header;                         /* sizeof(struct _memory_region) of the writer */
+    size_t  used;                           /* bytes used in the region */
+};
+
+ARENADEF int _arena_write_all(int fd, const void *buf, size_t size) {
+    const char *ptr = (const char *)buf;
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0) return -1;
+        ptr += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/* Write a contiguous arena to `path`. Returns 0 on success and -1 on failure (with errno set) */
+ARENADEF int arena_save(p_arena arena, const char *path) {
+    struct _memory_region *region = arena->head;
+    if (region == NULL || region != arena->tail) {
+        errno = EINVAL;                     /* only contiguous arenas have a single region to save */
+        return -1;
+    }
+
+    struct _arena_snapshot_header header;
+    struct _memory_region image = *region;
+    image.size = region->offset;
+    image.next = NULL;
+    image.next_avail = NULL;
+
+    memcpy(header.magic, ARENA_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.header = sizeof(*region);
+    header.used = region->offset;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    if (_arena_write_all(fd, &header, sizeof(header)) != 0 ||
+        lseek(fd, (off_t)_arena_page_size(), SEEK_SET) < 0 ||
+        _arena_write_all(fd, &image, sizeof(image)) != 0 ||
+        _arena_write_all(fd, region->mem, region->offset) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return close(fd);
 }
 
-#define arena_memclone(arena, ptr, size) memcpy(arena_alloc((arena), (size)), (ptr), (size))
+/*
+ * Map a snapshot written by arena_save into `arena` (which must be empty). The pages are loaded lazily and
+ * privately, and the region is extended to at least `capacity` bytes so it can keep growing after the load.
+ * Returns 0 on success and -1 on failure (with errno set).
+ */
+ARENADEF int arena_load_mmap(p_arena arena, const char *path, size_t capacity) {
+    struct _arena_snapshot_header header;
+    struct _memory_region *region = NULL;
+    struct stat st;
+    size_t page = _arena_page_size(), length = 0;
+    int fd, error = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return -1;
+
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        error = errno ? errno : EINVAL;
+    } else if (memcmp(header.magic, ARENA_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+               header.header != sizeof(*region) ||
+               (size_t)st.st_size != page + sizeof(*region) + header.used) {
+        error = EINVAL;
+    } else {
+        if (capacity < header.used) capacity = header.used;
+        length = (sizeof(*region) + capacity + page - 1) & ~(page - 1);
+
+        /* reserve the whole region, then place the file over its beginning */
+        region = (struct _memory_region *)mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            error = errno;
+        } else if (mmap(region, (size_t)st.st_size - page, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, (off_t)page) == MAP_FAILED) {
+            error = errno;
+            munmap(region, length);
+        }
+    }
+
+    close(fd);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+
+    region->size = length - sizeof(*region);
+    region->offset = header.used;
+    region->next = NULL;
+    region->next_avail = NULL;
+    region->index = 0;
+    region->retired = 0;
+
+    arena->head = arena->tail = arena->avail = region;
+    arena->total = length;
+    arena->flags = ARENA_CONTIGUOUS;
+    return 0;
+}
+#endif /* ARENA_MMAP_BACKEND */
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace arena {
+
+/*
+ * C++ interface over s_arena. Objects created with make<T>() whose destructor isn't trivial get a finalizer,
+ * allocated in the arena itself, and the finalizers run in reverse order of construction on reset() and when the
+ * Arena is destroyed. Trivially destructible types get no finalizer, only a block from arena_alloc_aligned, which
+ * may place a filler block of up to the type's alignment plus a header in front of it.
+ */
+class Arena {
+    struct Finalizer {
+        void        (*destroy)(void *);
+        void        *object;
+        Finalizer   *prev;
+    };
+
+    template <typename T> static void destroy(void *object) { static_cast<T *>(object)->~T(); }
+
+    s_arena     raw_;
+    Finalizer   *finalizers_;
+
+    void finalize(Finalizer *until) {
+        while (finalizers_ != until) {
+            Finalizer *finalizer = finalizers_;
+            finalizers_ = finalizer->prev;
+            finalizer->destroy(finalizer->object);
+        }
+    }
+
+public:
+    /* position of the arena and of its finalizer list */
+    struct Mark {
+        s_arena_mark    position;
+        Finalizer       *finalizers;
+    };
+
+    Arena() : raw_(), finalizers_(nullptr) {}
+    explicit Arena(unsigned flags) : raw_(), finalizers_(nullptr) { arena_init_flags(&raw_, flags); }
+    ~Arena() {
+        finalize(nullptr);
+        arena_deinit(&raw_);
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    s_arena *get() { return &raw_; }
+
+    void *alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+        return arena_alloc_aligned(&raw_, size, align);
+    }
+
+    template <typename T, typename... Args> T *make(Args &&...args) {
+        T *object = new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            Finalizer *finalizer = static_cast<Finalizer *>(alloc(sizeof(Finalizer), alignof(Finalizer)));
+            finalizer->destroy = &destroy<T>;
+            finalizer->object = object;
+            finalizer->prev = finalizers_;
+            finalizers_ = finalizer;
+        }
+        return object;
+    }
+
+    /* destroy every object and discard all allocations, keeping the regions */
+    void reset() {
+        finalize(nullptr);
+        arena_reset(&raw_);
+    }
+
+    Mark mark() {
+        Mark mark = { arena_mark(&raw_), finalizers_ };
+        return mark;
+    }
+
+    /* destroy the objects created since `mark` and rewind the arena to it */
+    void rewind(const Mark &mark) {
+        finalize(mark.finalizers);
+        arena_rewind(&raw_, mark.position);
+    }
+};
+
+#ifndef ARENA_SCRATCH_COUNT
+#define ARENA_SCRATCH_COUNT                 2
+#endif /* ARENA_SCRATCH_COUNT */
+
+/*
+ * Per-thread scratch arenas. A function that receives an arena to return results in asks for a scratch arena
+ * passing that one as a conflict, so its temporaries never end up rewinding (or being rewound with) the results.
+ */
+inline Arena &scratch(std::initializer_list<const Arena *> conflicts) {
+    static thread_local Arena arenas[ARENA_SCRATCH_COUNT];
+    for (Arena &candidate : arenas) {
+        bool conflict = false;
+        for (const Arena *used : conflicts) conflict = conflict || used == &candidate;
+        if (!conflict) return candidate;
+    }
+    _arena_fprintf(stderr, "%s:%d: No scratch arena left without conflicts\n", __FILE__, __LINE__);
+    abort();
+}
+
+inline Arena &scratch(const Arena *conflict = nullptr) {
+    return scratch({ conflict });
+}
+
+/* Rewinds an arena, destroying what was created in it, when the scope ends */
+class ScratchScope {
+    Arena       &arena_;
+    Arena::Mark mark_;
+
+public:
+    explicit ScratchScope(Arena &arena) : arena_(arena), mark_(arena.mark()) {}
+    explicit ScratchScope(const Arena *conflict = nullptr) : ScratchScope(scratch(conflict)) {}
+    explicit ScratchScope(std::initializer_list<const Arena *> conflicts) : ScratchScope(scratch(conflicts)) {}
+    ~ScratchScope() { arena_.rewind(mark_); }
+
+    ScratchScope(const ScratchScope &) = delete;
+    ScratchScope &operator=(const ScratchScope &) = delete;
+
+    Arena &arena() { return arena_; }
+    Arena *operator->() { return &arena_; }
+};
+
+} /* namespace arena */
+#endif /* __cplusplus */
 
 #endif /* arena.h */
@@ -19,31 +19,294 @@
 #ifndef __HASHMAP_H
 #define __HASHMAP_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
-/* initial size of the hashmap, set as a power of 2 for convenience. */
-#define HASHMAP_CAP_DEFAULT ((size_t)8)
+#define HASHMAP_GROUP       ((size_t)16)
+
+#ifdef HASHMAP_ROBIN_HOOD
+/*
+ * Robin Hood linear probing. Each slot has a control byte holding its entry's distance from the slot the hash
+ * points to, plus one (0 for an empty slot, saturated at 255). Entries of a run are kept in the order of their
+ * home slots, so a miss ends as soon as it reaches an entry closer to home than the probe, and deletion shifts
+ * the rest of the run back instead of leaving a deleted marker.
+ */
+#define HASHMAP_CTRL_EMPTY   0x00
+#define _HASHMAP_FULL(ctrl)  ((ctrl) != HASHMAP_CTRL_EMPTY)
+#else
+#if defined(__SSE2__) && !defined(HASHMAP_NO_SIMD)
+#define _HASHMAP_SSE2                       /* probe the control bytes of a whole group with one compare */
+#include <emmintrin.h>
+#endif
+
+/*
+ * Slots are probed in aligned groups of HASHMAP_GROUP. Each slot has a control byte in a separate array: the top
+ * 7 bits of the key's hash when the slot is full, or one of the markers below. Most lookups are resolved by
+ * comparing the control bytes of one group, and compare at most one key.
+ */
+#define HASHMAP_CTRL_EMPTY   0x80
+#define HASHMAP_CTRL_DELETED 0xFE
+#define _HASHMAP_FULL(ctrl)  (!((ctrl) & 0x80))
+#define _HASHMAP_H2(hash)    ((uint8_t)((hash) >> (sizeof(size_t) * 8 - 7)))
+#endif /* HASHMAP_ROBIN_HOOD */
+
+/* initial size of the hashmap, set as a power of 2 for convenience. Never less than one group */
+#define HASHMAP_CAP_DEFAULT HASHMAP_GROUP
 #define HASHMAP_CAP_MASK(hm) ((hm).capacity - 1)
 
+#ifdef HASHMAP_ARENA
+/*
+ * Arena backed hashmaps: a hashmap initialized with hashmap_init_arena allocates its tables (and its owned keys)
+ * from the given arena, so short-lived maps cost a few bump allocations and are released with the arena. Tables
+ * left behind by a resize are not given back, a map that keeps resizing should use the heap instead. The other
+ * hashmaps, with a NULL arena, use malloc as usual.
+ */
+#include "arena.h"
+
+#ifndef HASHMAP_ARENA_ALIGN
+#define HASHMAP_ARENA_ALIGN ((size_t)16)
+#endif /* HASHMAP_ARENA_ALIGN */
+
+static inline void *_hashmap_alloc(s_arena *arena, size_t size) {
+    if (arena == NULL) return malloc(size);
+    return arena_alloc_aligned(arena, size, HASHMAP_ARENA_ALIGN);
+}
+
+static inline void *_hashmap_calloc(s_arena *arena, size_t count, size_t size) {
+    if (arena == NULL) return calloc(count, size);
+    if (size != 0 && count > (size_t)-1 / size) return NULL;
+    /* arena memory is not zeroed */
+    return memset(_hashmap_alloc(arena, count * size), 0, count * size);
+}
+
+/* tables in an arena are released with it */
+static inline void _hashmap_free(s_arena *arena, void *ptr) {
+    if (arena == NULL) free(ptr);
+}
+
+#define _HASHMAP_ARENA_FIELD s_arena *arena; /* where the tables are allocated, NULL for the heap */
+#define _HASHMAP_ARENA(hm) ((hm).arena)
+#define _HASHMAP_INHERIT_ARENA(hm, from) ((hm).arena = (from).arena)
+#define _HASHMAP_RESET_ARENA(hm) ((hm).arena = NULL)
+#define hashmap_init_arena_cap(hm, a, cap) do { \
+    (hm).arena = (a); \
+    _hashmap_init_cap(hm, cap); \
+} while (0)
+#define hashmap_init_arena(hm, a) hashmap_init_arena_cap(hm, a, HASHMAP_CAP_DEFAULT)
+#else
+#define _hashmap_alloc(arena, size) malloc((size))
+#define _hashmap_calloc(arena, count, size) calloc((count), (size))
+#define _hashmap_free(arena, ptr) free((ptr))
+#define _HASHMAP_ARENA_FIELD
+#define _HASHMAP_ARENA(hm) NULL
+#define _HASHMAP_INHERIT_ARENA(hm, from) ((void)0)
+#define _HASHMAP_RESET_ARENA(hm) ((void)0)
+#endif /* HASHMAP_ARENA */
+
+#ifdef HASHMAP_OWNED_KEYS
+/*
+ * Owned keys: the hashmap keeps its own copy of every key, so the caller's buffer can go away after the put.
+ * Keys of up to HASHMAP_INLINE_KEY bytes are stored in the slot itself, which also saves following a pointer on
+ * every comparison, and longer ones are copied to the heap and freed when they are removed, or into the arena of the
+ * hashmap with HASHMAP_ARENA, where they stay until the arena is released.
+ */
+#ifndef HASHMAP_INLINE_KEY
+#define HASHMAP_INLINE_KEY 16
+#endif /* HASHMAP_INLINE_KEY */
+
+typedef struct {
+    union {
+        uint8_t *key;            /* copy of a longer key, on the heap or in the hashmap's arena */
+        uint8_t inline_key[HASHMAP_INLINE_KEY]; /* bytes of a short key */
+    };
+    size_t hash;                 /* hash of the key, kept so resizing doesn't have to read the key again */
+    uint32_t len;                /* number of bytes in the key */ 
+    uint8_t used;                /* set to 1 if this entry is being used */
+} s_hashmap_meta;
+
+static inline const uint8_t *_hashmap_meta_key(const s_hashmap_meta *meta) {
+    return meta->len <= HASHMAP_INLINE_KEY ? meta->inline_key : meta->key;
+}
+
+/* copy is the storage allocated for a key longer than HASHMAP_INLINE_KEY, NULL otherwise */
+static inline void _hashmap_meta_set_key(s_hashmap_meta *meta, const uint8_t *key, uint32_t len, uint8_t *copy) {
+    if (len <= HASHMAP_INLINE_KEY) memcpy(meta->inline_key, key, len);
+    else {
+        if (copy == NULL) {
+            fprintf(stderr, "%s:%d: Failed to copy key: malloc() failed to allocate %u bytes\n", __FILE__, __LINE__, len);
+            abort();
+        }
+        meta->key = copy;
+        memcpy(meta->key, key, len);
+    }
+}
+
+#define _HASHMAP_SET_KEY(hm, index, kbuf, klen) _hashmap_meta_set_key(&hashmap_meta((hm), (index)), (kbuf), (klen), \
+    (klen) > HASHMAP_INLINE_KEY ? (uint8_t *)_hashmap_alloc(_HASHMAP_ARENA(hm), (klen)) : NULL)
+#define _HASHMAP_DROP_KEY(hm, index) do { \
+    if (hashmap_meta((hm), (index)).len > HASHMAP_INLINE_KEY) _hashmap_free(_HASHMAP_ARENA(hm), hashmap_meta((hm), (index)).key); \
+} while (0)
+/* keys in an arena go away with it, heap copies are freed from the table (and the old one while resizing) */
+#define _HASHMAP_KEYS_DEINIT(hm) do { \
+    if (_HASHMAP_ARENA(hm) == NULL) { \
+        const s_hashmap_table *__hashmap_keys_table = _HASHMAP_TABLE(hm); \
+        _hashmap_free_keys(__hashmap_keys_table); \
+        _HASHMAP_FREE_OLD_KEYS(hm, __hashmap_keys_table); \
+    } \
+} while (0)
+#else
 typedef struct {
     uint8_t *key;                /* pointer to the key bytes */ 
+    size_t hash;                 /* hash of the key, kept so resizing doesn't have to read the key again */
     uint32_t len;                /* number of bytes in the key */ 
     uint8_t used;                /* set to 1 if this entry is being used */
 } s_hashmap_meta;
 
-#define MAKE_HASHMAP(type) \
-    size_t count;                /* number of occupied entries */ \
-    ssize_t index;               /* used when searching for a key */ \
-    size_t capacity;             /* Total capacity of the hashmap, will grow as needed */ \
-    uint32_t maxcol;             /* the maximum number of collisions we found, used as a higher limit on lookup */ \
+static inline const uint8_t *_hashmap_meta_key(const s_hashmap_meta *meta) {
+    return meta->key;
+}
+
+#define _HASHMAP_SET_KEY(hm, index, kbuf, klen) (hashmap_meta((hm), (index)).key = (uint8_t *)(kbuf))
+#define _HASHMAP_DROP_KEY(hm, index) ((void)0)
+#define _HASHMAP_KEYS_DEINIT(hm) ((void)0)
+#endif /* HASHMAP_OWNED_KEYS */
+
+#ifdef HASHMAP_INCREMENTAL
+/*
+ * Incremental resizing. Instead of moving every entry at once, a resize keeps the old table around and each
+ * operation on the hashmap moves the entries of up to HASHMAP_MIGRATE_STEP of its slots to the new one, so no
+ * single put pays for the whole table. Lookups check the new table and then the old one, and an entry found in
+ * the old table is moved right away. The load factor counts the entries of both tables, so the new one always
+ * has room for all of them.
+ */
+#ifndef HASHMAP_MIGRATE_STEP
+#define HASHMAP_MIGRATE_STEP ((size_t)8)
+#endif /* HASHMAP_MIGRATE_STEP */
+
+typedef struct {
+    uint8_t *ctrl;               /* control bytes of the table being moved from, NULL when not resizing */
+    uint8_t *meta;
+    uint8_t *data;
+    size_t capacity;
+    size_t count;                /* entries still in it */
+    size_t migrated;             /* slots before this one are empty */
+#ifdef HASHMAP_ARENA
+    s_arena *arena;              /* where its tables are allocated, see _HASHMAP_ARENA_FIELD */
+#endif /* HASHMAP_ARENA */
+} s_hashmap_old;
+
+#define _HASHMAP_OLD_FIELD s_hashmap_old old; /* table being moved from by a resize */
+#define _HASHMAP_INIT_OLD(hm) memset(&(hm).old, 0, sizeof((hm).old))
+#define _HASHMAP_FREE_OLD_KEYS(hm, t) do { \
+    s_hashmap_table __hashmap_old_keys = _hashmap_old_table(&(hm).old, (t)); \
+    _hashmap_free_keys(&__hashmap_old_keys); \
+} while (0)
+#else
+#define _HASHMAP_OLD_FIELD
+#define _HASHMAP_INIT_OLD(hm) ((void)0)
+#define _HASHMAP_FREE_OLD_KEYS(hm, t) ((void)0)
+#endif /* HASHMAP_INCREMENTAL */
+
+/* the parts of a hashmap the functions below work on, see _HASHMAP_TABLE */
+typedef struct {
+    uint8_t *ctrl;               /* control byte of each slot */
+    uint8_t *meta;               /* metadata of the first slot */
+    uint8_t *data;               /* value of the first slot, NULL when values are stored after their metadata */
+    size_t metalen;              /* distance between the metadata of two slots */
+    size_t datalen;              /* size of a value stored apart */
+    size_t capacity;
+    uint8_t u64;                 /* the metadata of a slot is just a uint64_t key, see MAKE_HASHMAP_U64 */
+} s_hashmap_table;
+
+/*
+ * The metadata of an integer keyed map (MAKE_HASHMAP_U64) is its bare key, and s_hashmap_meta is never that small,
+ * so the generic macros can tell both kinds apart at compile time and share rehash, resize and iteration.
+ */
+#define _HASHMAP_IS_U64(hm) (sizeof(hashmap_meta((hm), 0)) == sizeof(uint64_t))
+
+#if defined(HASHMAP_ORDERED)
+/*
+ * Insertion ordered layout, like the dict of CPython: entries are appended to a dense array in the order they were
+ * put, and a slot only holds the position of its entry. Iterating goes through the entries instead of every slot,
+ * and the array only needs room for the 7/8 of the slots the load factor allows. A removed entry stays as a hole
+ * until the next rehash compacts the array. hashmap_at and hashmap_meta take positions in the array, which is what
+ * lookups and iteration return. MAKE_HASHMAP_U64 is not available, its entries have no way to mark a hole.
+ */
+#if defined(HASHMAP_SOA) || defined(HASHMAP_INCREMENTAL)
+#error "HASHMAP_ORDERED can not be combined with HASHMAP_SOA or HASHMAP_INCREMENTAL"
+#endif
+#define _HASHMAP_SLOTS(type) \
+    uint32_t *slots;             /* entry of each slot */ \
+    size_t length;               /* entries appended since the last rehash, holes included */ \
+    struct { \
+        s_hashmap_meta meta;     /*  metadata of the entry */ \
+        type data;               /* the actual data that this entry holds */ \
+    } *items                     /* entries in insertion order */
+#define _HASHMAP_ROOM(cap) ((cap) - (cap) / 8)
+#define _HASHMAP_TABLE(hm) \
+    (&(s_hashmap_table){ (hm).ctrl, (uint8_t *)(hm).slots, (uint8_t *)(hm).items, sizeof(*(hm).slots), sizeof(*(hm).items), (hm).capacity, _HASHMAP_IS_U64(hm) })
+#define _HASHMAP_SLOTS_ALLOC(hm, cap) \
+    ((hm).length = 0, (hm).slots = _hashmap_calloc(_HASHMAP_ARENA(hm), (cap), sizeof(*(hm).slots)), (hm).items = _hashmap_calloc(_HASHMAP_ARENA(hm), _HASHMAP_ROOM(cap), sizeof(*(hm).items)), (hm).slots && (hm).items)
+#define _HASHMAP_SLOTS_FREE(hm) (_hashmap_free(_HASHMAP_ARENA(hm), (hm).slots), _hashmap_free(_HASHMAP_ARENA(hm), (hm).items), (hm).slots = NULL, (hm).items = NULL, (hm).length = 0)
+#define _HASHMAP_SLOTS_TAKE(hm, from) ((hm).slots = (from).slots, (hm).items = (from).items, (hm).length = (from).length)
+#define _HASHMAP_LOAD(hm) ((hm).length)
+#define _HASHMAP_ENTRY(hm, slot) _hashmap_entry((hm).slots, (slot))
+#define _HASHMAP_PLACE(hm, slot) ((hm).slots[(slot)] = (uint32_t)(hm).length, (hm).length ++)
+#define hashmap_meta(hm, index) (hm).items[(index)].meta
+#define hashmap_at(hm, index) (hm).items[(index)].data
+#elif defined(HASHMAP_SOA)
+/*
+ * Struct of arrays: the metadata and the values of the slots are kept in two separate arrays, so probing only
+ * goes through the dense metadata and a value is only read on a hit, however large its type is.
+ */
+#define _HASHMAP_SLOTS(type) \
+    s_hashmap_meta *meta;        /* metadata of each slot */ \
+    type *data                   /* value of each slot */
+#define _HASHMAP_TABLE(hm) \
+    (&(s_hashmap_table){ (hm).ctrl, (uint8_t *)(hm).meta, (uint8_t *)(hm).data, sizeof(*(hm).meta), sizeof(*(hm).data), (hm).capacity, _HASHMAP_IS_U64(hm) })
+#define _HASHMAP_SLOTS_ALLOC(hm, cap) \
+    ((hm).meta = _hashmap_calloc(_HASHMAP_ARENA(hm), (cap), sizeof(*(hm).meta)), (hm).data = _hashmap_calloc(_HASHMAP_ARENA(hm), (cap), sizeof(*(hm).data)), (hm).meta && (hm).data)
+#define _HASHMAP_SLOTS_FREE(hm) (_hashmap_free(_HASHMAP_ARENA(hm), (hm).meta), _hashmap_free(_HASHMAP_ARENA(hm), (hm).data), (hm).meta = NULL, (hm).data = NULL)
+#define _HASHMAP_SLOTS_TAKE(hm, from) ((hm).meta = (from).meta, (hm).data = (from).data)
+#define hashmap_meta(hm, index) (hm).meta[(index)]
+#define hashmap_at(hm, index) (hm).data[(index)]
+#else
+#define _HASHMAP_SLOTS(type) \
     struct { \
         s_hashmap_meta meta; /*  metadata of the entry */\
         type data;               /* the actual data that this entry holds */ \
     } *items
+#define _HASHMAP_TABLE(hm) \
+    (&(s_hashmap_table){ (hm).ctrl, (uint8_t *)(hm).items, NULL, sizeof(*(hm).items), 0, (hm).capacity, _HASHMAP_IS_U64(hm) })
+#define _HASHMAP_SLOTS_ALLOC(hm, cap) (((hm).items = _hashmap_calloc(_HASHMAP_ARENA(hm), (cap), sizeof(*(hm).items))) != NULL)
+#define _HASHMAP_SLOTS_FREE(hm) (_hashmap_free(_HASHMAP_ARENA(hm), (hm).items), (hm).items = NULL)
+#define _HASHMAP_SLOTS_TAKE(hm, from) ((hm).items = (from).items)
+#define hashmap_meta(hm, index) (hm).items[(index)].meta
+#define hashmap_at(hm, index) (hm).items[(index)].data
+#endif /* HASHMAP_ORDERED */
 
-static inline size_t hashmap_hash(const uint8_t *str, uint32_t len) {
+#ifndef HASHMAP_ORDERED
+/* each slot holds its entry, so positions are slots and every slot can be used */
+#define _HASHMAP_ROOM(cap) (cap)
+#define _HASHMAP_LOAD(hm) ((hm).count + (hm).tombs)
+#define _HASHMAP_ENTRY(hm, slot) (slot)
+#define _HASHMAP_PLACE(hm, slot) (slot)
+#endif /* HASHMAP_ORDERED */
+
+#define MAKE_HASHMAP(type) \
+    size_t count;                /* number of occupied entries */ \
+    ssize_t index;               /* used when searching for a key */ \
+    size_t capacity;             /* Total capacity of the hashmap, will grow as needed */ \
+    size_t tombs;                /* number of deleted slots, they count towards the load factor */ \
+    uint8_t *ctrl;               /* control byte of each slot */ \
+    _HASHMAP_OLD_FIELD \
+    _HASHMAP_ARENA_FIELD \
+    _HASHMAP_SLOTS(type)
+
+static inline size_t hashmap_hash_fnv1(const uint8_t *str, uint32_t len) {
     /* FNV-1 hash */
     size_t i, hash = 0xcbf29ce484222325;
     for (i = 0; i < len; i ++) {
@@ -53,116 +316,758 @@ static inline size_t hashmap_hash(const uint8_t *str, uint32_t len) {
     return hash;
 }
 
-static inline ssize_t hashmap_lookup(const void *items, size_t itemlen, size_t capacity, uint32_t maxcol, const uint8_t *str, uint32_t len) {
-    if (!items) return -1;
-    size_t mask = capacity - 1;
-    size_t index = hashmap_hash(str, len) & mask;
-    uint32_t col = 0;
-    while (col <= maxcol) {
-        const s_hashmap_meta *meta = (void *)((size_t)items + index * itemlen);
-        if (meta->used && meta->key[0] == str[0] && meta->len == len && memcmp(str, meta->key, len) == 0) return index;
-        col ++;
+/* full 128 bit product of a and b, low half in *a and high half in *b */
+static inline void _hashmap_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t _hashmap_mix(uint64_t a, uint64_t b) {
+    _hashmap_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t _hashmap_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t _hashmap_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * wyhash (final version 4). Reads 8 bytes at a time, or 48 at a time in three independent lanes for long keys,
+ * and keys of up to 16 bytes take a couple of overlapping loads and no loop. All bits of the result depend on
+ * every byte, so the low bits used for the home slot are as good as the high bits used for the control byte.
+ */
+static inline size_t hashmap_hash(const uint8_t *str, uint32_t len) {
+    static const uint64_t secret[4] = {
+        0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+    };
+    const uint8_t *p = str;
+    uint64_t seed = _hashmap_mix(secret[0], secret[1]);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (_hashmap_read32(p) << 32) | _hashmap_read32(p + ((len >> 3) << 2));
+            b = (_hashmap_read32(p + len - 4) << 32) | _hashmap_read32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = _hashmap_mix(_hashmap_read64(p) ^ secret[1], _hashmap_read64(p + 8) ^ seed);
+                see1 = _hashmap_mix(_hashmap_read64(p + 16) ^ secret[2], _hashmap_read64(p + 24) ^ see1);
+                see2 = _hashmap_mix(_hashmap_read64(p + 32) ^ secret[3], _hashmap_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = _hashmap_mix(_hashmap_read64(p) ^ secret[1], _hashmap_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = _hashmap_read64(p + i - 16);
+        b = _hashmap_read64(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    _hashmap_mum(&a, &b);
+    return (size_t)_hashmap_mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+/* to use another hash, define HASHMAP_HASH_FN as a function or macro taking (const uint8_t *str, uint32_t len) */
+#ifndef HASHMAP_HASH_FN
+#define HASHMAP_HASH_FN hashmap_hash
+#endif /* HASHMAP_HASH_FN */
+
+/* finalizer of MurmurHash3, every bit of x affects every bit of the result */
+static inline size_t hashmap_hash_u64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+/* the same for integer keys, taking (uint64_t key) */
+#ifndef HASHMAP_U64_HASH_FN
+#define HASHMAP_U64_HASH_FN hashmap_hash_u64
+#endif /* HASHMAP_U64_HASH_FN */
+
+static inline s_hashmap_meta *_hashmap_slot_meta(const s_hashmap_table *t, size_t index) {
+#ifdef HASHMAP_ORDERED
+    return (s_hashmap_meta *)(t->data + ((const uint32_t *)t->meta)[index] * t->datalen);
+#else
+    return (s_hashmap_meta *)(t->meta + index * t->metalen);
+#endif
+}
+
+#ifdef HASHMAP_ORDERED
+/* position of the entry in slot, or -1 */
+static inline ssize_t _hashmap_entry(const uint32_t *slots, ssize_t slot) {
+    return slot < 0 ? -1 : (ssize_t)slots[slot];
+}
+#endif /* HASHMAP_ORDERED */
+
+/* key in slot index of an integer keyed table */
+static inline uint64_t _hashmap_slot_key(const s_hashmap_table *t, size_t index) {
+    return *(const uint64_t *)(t->meta + index * t->metalen);
+}
+
+/* hash of the key in slot index, integer keys are cheaper to hash again than to store it */
+static inline size_t _hashmap_slot_hash(const s_hashmap_table *t, size_t index) {
+    if (t->u64) return HASHMAP_U64_HASH_FN(_hashmap_slot_key(t, index));
+    return _hashmap_slot_meta(t, index)->hash;
+}
+
+/* copy the entry in slot src of table from to slot dst of table to */
+static inline void _hashmap_slot_copy(const s_hashmap_table *to, size_t dst, const s_hashmap_table *from, size_t src) {
+    memcpy(to->meta + dst * to->metalen, from->meta + src * from->metalen, to->metalen);
+#ifndef HASHMAP_ORDERED
+    if (to->data) memcpy(to->data + dst * to->datalen, from->data + src * from->datalen, to->datalen);
+#endif
+}
+
+/* mark the slot that was emptied by an erase as unused. Ordered entries do not move, hashmap_remove marks them */
+static inline void _hashmap_slot_clear(const s_hashmap_table *t, size_t index) {
+#ifndef HASHMAP_ORDERED
+    if (!t->u64) _hashmap_slot_meta(t, index)->used = 0;
+#else
+    (void)t; (void)index;
+#endif
+}
+
+#ifdef HASHMAP_OWNED_KEYS
+/* free the heap copies of the long keys of the entries in the table */
+static inline void _hashmap_free_keys(const s_hashmap_table *t) {
+    size_t index;
+    if (t->ctrl == NULL || t->u64) return;
+    for (index = 0; index < t->capacity; index ++) {
+        if (!_HASHMAP_FULL(t->ctrl[index])) continue;
+        s_hashmap_meta *meta = _hashmap_slot_meta(t, index);
+        if (meta->len > HASHMAP_INLINE_KEY) free(meta->key);
+    }
+}
+#endif /* HASHMAP_OWNED_KEYS */
+
+#ifdef HASHMAP_ROBIN_HOOD
+/* distance of the entry in slot index from its home slot */
+static inline size_t _hashmap_probe_length(const s_hashmap_table *t, size_t index) {
+    if (t->ctrl[index] < 0xFF) return t->ctrl[index] - 1;
+    return (index - _hashmap_slot_hash(t, index)) & (t->capacity - 1);
+}
+
+#define _HASHMAP_RH_CTRL(distance) ((uint8_t)((distance) < 0xFE ? (distance) + 1 : 0xFF))
+
+static inline ssize_t _hashmap_find(const s_hashmap_table *t, size_t hash, const uint8_t *str, uint32_t len) {
+    size_t mask = t->capacity - 1;
+    size_t index = hash & mask;
+    size_t distance = 0;
+    while (t->ctrl[index] != HASHMAP_CTRL_EMPTY && _hashmap_probe_length(t, index) >= distance) {
+        const s_hashmap_meta *meta = _hashmap_slot_meta(t, index);
+        if (meta->hash == hash && meta->len == len && memcmp(str, _hashmap_meta_key(meta), len) == 0) return index;
+        index = (index + 1) & mask;
+        distance ++;
+    }
+    return -1;
+}
+
+/*
+ * Take the slot for a new entry: the first one whose entry is closer to its home than the new one would be.
+ * The rest of the run moves one slot forward to make room.
+ */
+static inline size_t _hashmap_claim(const s_hashmap_table *t, size_t hash, size_t *tombs) {
+    (void)tombs;
+    size_t mask = t->capacity - 1;
+    size_t index = hash & mask;
+    size_t distance = 0;
+    while (t->ctrl[index] != HASHMAP_CTRL_EMPTY && _hashmap_probe_length(t, index) >= distance) {
         index = (index + 1) & mask;
+        distance ++;
+    }
+    size_t last = index;
+    while (t->ctrl[last] != HASHMAP_CTRL_EMPTY) last = (last + 1) & mask;
+    while (last != index) {
+        size_t prev = (last - 1) & mask;
+        t->ctrl[last] = _HASHMAP_RH_CTRL(_hashmap_probe_length(t, prev) + 1);
+        _hashmap_slot_copy(t, last, t, prev);
+        last = prev;
+    }
+    t->ctrl[index] = _HASHMAP_RH_CTRL(distance);
+    return index;
+}
+
+/* backward shift: the rest of the run moves one slot closer to home */
+static inline void _hashmap_erase(const s_hashmap_table *t, size_t index, size_t *tombs) {
+    (void)tombs;
+    size_t mask = t->capacity - 1;
+    size_t next = (index + 1) & mask;
+    while (t->ctrl[next] != HASHMAP_CTRL_EMPTY && t->ctrl[next] != 1) {
+        t->ctrl[index] = _HASHMAP_RH_CTRL(_hashmap_probe_length(t, next) - 1);
+        _hashmap_slot_copy(t, index, t, next);
+        index = next;
+        next = (next + 1) & mask;
+    }
+    t->ctrl[index] = HASHMAP_CTRL_EMPTY;
+    _hashmap_slot_clear(t, index);
+}
+#else
+/* bit i is set if the control byte of slot i in the group equals tag */
+static inline uint32_t _hashmap_group_match(const uint8_t *ctrl, uint8_t tag) {
+#ifdef _HASHMAP_SSE2
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t i, mask = 0;
+    for (i = 0; i < HASHMAP_GROUP; i ++) mask |= (uint32_t)(ctrl[i] == tag) << i;
+    return mask;
+#endif
+}
+
+/* bit i is set if slot i in the group is empty or deleted */
+static inline uint32_t _hashmap_group_free(const uint8_t *ctrl) {
+#ifdef _HASHMAP_SSE2
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    uint32_t i, mask = 0;
+    for (i = 0; i < HASHMAP_GROUP; i ++) mask |= (uint32_t)(ctrl[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+/*
+ * Groups are visited in triangular steps from the one the hash points to, which covers every group of a power
+ * of 2 sized table. A probe ends at the first group with an empty slot.
+ */
+static inline ssize_t _hashmap_find(const s_hashmap_table *t, size_t hash, const uint8_t *str, uint32_t len) {
+    size_t mask = t->capacity - 1;
+    size_t pos = hash & mask & ~(HASHMAP_GROUP - 1);
+    size_t step = 0;
+    uint8_t tag = _HASHMAP_H2(hash);
+    while (step < t->capacity) {
+        uint32_t match = _hashmap_group_match(t->ctrl + pos, tag);
+        while (match) {
+            size_t index = pos + (size_t)__builtin_ctz(match);
+            const s_hashmap_meta *meta = _hashmap_slot_meta(t, index);
+            if (meta->hash == hash && meta->len == len && memcmp(str, _hashmap_meta_key(meta), len) == 0) return index;
+            match &= match - 1;
+        }
+        if (_hashmap_group_match(t->ctrl + pos, HASHMAP_CTRL_EMPTY)) break;
+        step += HASHMAP_GROUP;
+        pos = (pos + step) & mask;
     }
     return -1;
 }
 
+/* first empty or deleted slot on the probe sequence of hash. The load factor guarantees there is one */
+static inline size_t _hashmap_find_free(const uint8_t *ctrl, size_t capacity, size_t hash) {
+    size_t mask = capacity - 1;
+    size_t pos = hash & mask & ~(HASHMAP_GROUP - 1);
+    size_t step = 0;
+    uint32_t avail;
+    while ((avail = _hashmap_group_free(ctrl + pos)) == 0) {
+        step += HASHMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+    return pos + (size_t)__builtin_ctz(avail);
+}
+
+/* take the slot for a new entry, its control byte is set to the tag of hash */
+static inline size_t _hashmap_claim(const s_hashmap_table *t, size_t hash, size_t *tombs) {
+    size_t index = _hashmap_find_free(t->ctrl, t->capacity, hash);
+    if (t->ctrl[index] == HASHMAP_CTRL_DELETED) *tombs -= 1;
+    t->ctrl[index] = _HASHMAP_H2(hash);
+    return index;
+}
 
-#define hashmap_init_cap(hm, cap) do { \
-    (hm).items = calloc((cap), sizeof(*(hm).items)); \
-    if ((hm).items == NULL) { \
-        fprintf(stderr, "%s:%d: Failed to init hashmap: calloc() failed to allocate %lu bytes\n", __FILE__, __LINE__, (size_t)(cap)); \
+static inline void _hashmap_erase(const s_hashmap_table *t, size_t index, size_t *tombs) {
+    /*
+     * A group with an empty slot ends every probe that reaches it, so no key lives past it and the slot can be
+     * emptied. Otherwise it must be marked deleted to keep the probes going.
+     */
+    if (_hashmap_group_match(t->ctrl + (index & ~(HASHMAP_GROUP - 1)), HASHMAP_CTRL_EMPTY)) {
+        t->ctrl[index] = HASHMAP_CTRL_EMPTY;
+    } else {
+        t->ctrl[index] = HASHMAP_CTRL_DELETED;
+        *tombs += 1;
+    }
+    _hashmap_slot_clear(t, index);
+}
+
+/* number of groups between the one the hash of the entry points to and the one it is in */
+static inline size_t _hashmap_probe_length(const s_hashmap_table *t, size_t index) {
+    size_t mask = t->capacity - 1;
+    size_t pos = _hashmap_slot_hash(t, index) & mask & ~(HASHMAP_GROUP - 1);
+    size_t step = 0, length = 0;
+    while (pos != (index & ~(HASHMAP_GROUP - 1))) {
+        step += HASHMAP_GROUP;
+        pos = (pos + step) & mask;
+        length ++;
+    }
+    return length;
+}
+#endif /* HASHMAP_ROBIN_HOOD */
+
+static inline ssize_t hashmap_lookup(const s_hashmap_table *t, const uint8_t *str, uint32_t len) {
+    if (!t->meta) return -1;
+    return _hashmap_find(t, HASHMAP_HASH_FN(str, len), str, len);
+}
+
+#ifdef HASHMAP_INCREMENTAL
+/* the old table, laid out like the new one */
+static inline s_hashmap_table _hashmap_old_table(const s_hashmap_old *old, const s_hashmap_table *t) {
+    s_hashmap_table table = { old->ctrl, old->meta, old->data, t->metalen, t->datalen, old->capacity, t->u64 };
+    return table;
+}
+
+/* move the entry in slot index of the old table to the new one, returns its new slot */
+static inline size_t _hashmap_migrate_slot(s_hashmap_old *old, size_t index, const s_hashmap_table *t, size_t *tombs) {
+    size_t old_tombs = 0;
+    s_hashmap_table from = _hashmap_old_table(old, t);
+    size_t slot = _hashmap_claim(t, _hashmap_slot_hash(&from, index), tombs);
+    _hashmap_slot_copy(t, slot, &from, index);
+    _hashmap_erase(&from, index, &old_tombs);
+    old->count --;
+    return slot;
+}
+
+/* move the entries of up to budget slots of the old table, and release it once it is empty */
+static inline void _hashmap_migrate(s_hashmap_old *old, const s_hashmap_table *t, size_t *tombs, size_t budget) {
+    if (old->ctrl == NULL) return;
+    while (old->count > 0 && budget > 0) {
+        /* a slot is only left once it is empty, erasing may shift the next entry into it */
+        if (_HASHMAP_FULL(old->ctrl[old->migrated])) _hashmap_migrate_slot(old, old->migrated, t, tombs);
+        else old->migrated ++;
+        budget --;
+    }
+    if (old->count == 0) {
+        _hashmap_free(old->arena, old->ctrl);
+        _hashmap_free(old->arena, old->meta);
+        _hashmap_free(old->arena, old->data);
+        memset(old, 0, sizeof(*old));
+    }
+}
+
+static inline ssize_t _hashmap_find_incremental(s_hashmap_old *old, const s_hashmap_table *t, size_t *tombs, size_t hash, const uint8_t *str, uint32_t len) {
+    _hashmap_migrate(old, t, tombs, HASHMAP_MIGRATE_STEP);
+    ssize_t index = _hashmap_find(t, hash, str, len);
+    if (index >= 0 || old->ctrl == NULL) return index;
+    s_hashmap_table from = _hashmap_old_table(old, t);
+    index = _hashmap_find(&from, hash, str, len);
+    if (index < 0) return -1;
+    return _hashmap_migrate_slot(old, index, t, tombs);
+}
+
+static inline ssize_t hashmap_lookup_incremental(s_hashmap_old *old, const s_hashmap_table *t, size_t *tombs, const uint8_t *str, uint32_t len) {
+    if (!t->meta) return -1;
+    return _hashmap_find_incremental(old, t, tombs, HASHMAP_HASH_FN(str, len), str, len);
+}
+
+#define _HASHMAP_FIND(hm, khash, kbuf, klen) \
+    _hashmap_find_incremental(&(hm).old, _HASHMAP_TABLE(hm), &(hm).tombs, (khash), (kbuf), (klen))
+#define _HASHMAP_LOOKUP(hm, kbuf, klen) \
+    hashmap_lookup_incremental(&(hm).old, _HASHMAP_TABLE(hm), &(hm).tombs, (kbuf), (klen))
+#define _HASHMAP_FINISH(hm) \
+    _hashmap_migrate(&(hm).old, _HASHMAP_TABLE(hm), &(hm).tombs, (size_t)-1)
+#else
+#define _HASHMAP_FIND(hm, khash, kbuf, klen) _hashmap_find(_HASHMAP_TABLE(hm), (khash), (kbuf), (klen))
+#define _HASHMAP_LOOKUP(hm, kbuf, klen) hashmap_lookup(_HASHMAP_TABLE(hm), (kbuf), (klen))
+#define _HASHMAP_FINISH(hm) ((void)0)
+#endif /* HASHMAP_INCREMENTAL */
+
+/*
+ * Count the entries by probe length (in groups, or in slots with HASHMAP_ROBIN_HOOD) into hist[0..n-1]. Entries
+ * with longer probes are counted in hist[n-1]. Returns the longest probe length.
+ */
+static inline size_t _hashmap_probe_histogram(const s_hashmap_table *t, size_t *hist, size_t n) {
+    size_t index, longest = 0;
+    memset(hist, 0, n * sizeof(*hist));
+    for (index = 0; index < t->capacity; index ++) {
+        if (!_HASHMAP_FULL(t->ctrl[index])) continue;
+        size_t length = _hashmap_probe_length(t, index);
+        if (length > longest) longest = length;
+        hist[length < n ? length : n - 1] ++;
+    }
+    return longest;
+}
+
+#if defined(HASHMAP_ORDERED)
+/* first entry at or after index that was not removed, or end when there is none */
+static inline size_t _hashmap_next(const s_hashmap_table *t, size_t end, size_t index) {
+    while (index < end && !((const s_hashmap_meta *)(t->data + index * t->datalen))->used) index ++;
+    return index;
+}
+#elif defined(HASHMAP_ROBIN_HOOD)
+/* first full slot at or after index, or end when there is none */
+static inline size_t _hashmap_next(const s_hashmap_table *t, size_t end, size_t index) {
+    while (index < end && t->ctrl[index] == HASHMAP_CTRL_EMPTY) index ++;
+    return index;
+}
+#else
+/* first full slot at or after index, or end when there is none. The control bytes are read a group at a time */
+static inline size_t _hashmap_next(const s_hashmap_table *t, size_t end, size_t index) {
+    if (index >= end) return end;
+    size_t pos = index & ~(HASHMAP_GROUP - 1);
+    uint32_t full = ~_hashmap_group_free(t->ctrl + pos) & (0xFFFFu << (index - pos)) & 0xFFFF;
+    while (full == 0) {
+        pos += HASHMAP_GROUP;
+        if (pos >= end) return end;
+        full = ~_hashmap_group_free(t->ctrl + pos) & 0xFFFF;
+    }
+    return pos + (size_t)__builtin_ctz(full);
+}
+#endif /* HASHMAP_ORDERED */
+
+/* init the tables in the arena the hashmap already has, see hashmap_init_arena_cap */
+#define _hashmap_init_cap(hm, cap) do { \
+    /* probing masks with capacity - 1 and loads whole groups, so it is a power of 2 and at least one group */ \
+    size_t __hashmap_init_cap_cap = HASHMAP_GROUP; \
+    while (__hashmap_init_cap_cap < (size_t)(cap)) __hashmap_init_cap_cap <<= 1; \
+    (hm).ctrl = _hashmap_alloc(_HASHMAP_ARENA(hm), __hashmap_init_cap_cap); \
+    if (!_HASHMAP_SLOTS_ALLOC(hm, __hashmap_init_cap_cap) || (hm).ctrl == NULL) { \
+        fprintf(stderr, "%s:%d: Failed to init hashmap: calloc() failed to allocate %lu bytes\n", __FILE__, __LINE__, __hashmap_init_cap_cap); \
         abort(); \
     } \
+    memset((hm).ctrl, HASHMAP_CTRL_EMPTY, __hashmap_init_cap_cap); \
+    _HASHMAP_INIT_OLD(hm); \
     (hm).count = 0; \
-    (hm).maxcol = 0; \
-    (hm).capacity = (cap); \
+    (hm).tombs = 0; \
+    (hm).capacity = __hashmap_init_cap_cap; \
+} while (0)
+
+#define hashmap_init_cap(hm, cap) do { \
+    _HASHMAP_RESET_ARENA(hm); \
+    _hashmap_init_cap(hm, cap); \
 } while (0)
 
 #define hashmap_deinit(hm) do { \
+    _HASHMAP_KEYS_DEINIT(hm); \
+    _hashmap_deinit_table(hm); \
+} while (0)
+
+/* release the slots, without the keys they may own */
+#define _hashmap_deinit_table(hm) do { \
+    _HASHMAP_DEINIT_OLD(hm); \
     (hm).count = 0; \
+    (hm).tombs = 0; \
     (hm).capacity = 0; \
-    free((hm).items); \
-    (hm).items = NULL; \
+    _HASHMAP_SLOTS_FREE(hm); \
+    _hashmap_free(_HASHMAP_ARENA(hm), (hm).ctrl); \
+    (hm).ctrl = NULL; \
 } while (0)
 
-#define hashmap_at(hm, index) (hm).items[(index)].data
-#define hashmap_get(hm, kstr, klen) ((hm).index = hashmap_lookup((hm).items, sizeof(*(hm).items), (hm).capacity, (hm).maxcol, (uint8_t *)(kstr), (klen)), (hm).items[(hm).index].data)
+#ifdef HASHMAP_INCREMENTAL
+#define _HASHMAP_DEINIT_OLD(hm) do { \
+    _hashmap_free((hm).old.arena, (hm).old.ctrl); \
+    _hashmap_free((hm).old.arena, (hm).old.meta); \
+    _hashmap_free((hm).old.arena, (hm).old.data); \
+    memset(&(hm).old, 0, sizeof((hm).old)); \
+} while (0)
+
+/* start moving every entry to a new table of the given capacity, finishing any resize still in progress */
+#define _hashmap_resize(hm, cap) do { \
+    _HASHMAP_FINISH(hm); \
+    __typeof__((hm)) __hashmap_resize_tmp = { 0 }; \
+    _HASHMAP_INHERIT_ARENA(__hashmap_resize_tmp, hm); \
+    _hashmap_init_cap(__hashmap_resize_tmp, (cap)); \
+    s_hashmap_table *__hashmap_resize_table = _HASHMAP_TABLE(hm); \
+    (hm).old.ctrl = __hashmap_resize_table->ctrl; \
+    (hm).old.meta = __hashmap_resize_table->meta; \
+    (hm).old.data = __hashmap_resize_table->data; \
+    (hm).old.capacity = (hm).capacity; \
+    (hm).old.count = (hm).count; \
+    (hm).old.migrated = 0; \
+    _HASHMAP_INHERIT_ARENA((hm).old, hm); \
+    _HASHMAP_SLOTS_TAKE(hm, __hashmap_resize_tmp); \
+    (hm).ctrl = __hashmap_resize_tmp.ctrl; \
+    (hm).tombs = 0; \
+    (hm).capacity = __hashmap_resize_tmp.capacity; \
+} while (0)
+#else
+#define _HASHMAP_DEINIT_OLD(hm) ((void)0)
+#define _hashmap_resize(hm, cap) hashmap_rehash(hm, cap)
+#endif /* HASHMAP_INCREMENTAL */
+
+#define hashmap_get(hm, kstr, klen) ((hm).index = _HASHMAP_ENTRY((hm), _HASHMAP_LOOKUP((hm), (uint8_t *)(kstr), (klen))), hashmap_at((hm), (hm).index))
 #define hashmap_init(hm) hashmap_init_cap(hm, HASHMAP_CAP_DEFAULT) 
 #define hashmap_avail(hm) ((hm).capacity - (hm).count)
-#define hashmap_index(hm, kstr, klen) ((hm).index = hashmap_lookup((hm).items, sizeof(*(hm).items), (hm).capacity, (hm).maxcol, (uint8_t *)(kstr), (klen)), (hm).index)
-#define hashmap_contains(hm, kstr, klen) ((hm).index = hashmap_lookup((hm).items, sizeof(*(hm).items), (hm).capacity, (hm).maxcol, (uint8_t *)(kstr), (klen)), (hm).index >= 0)
-#define hashmap_match_item(item, kbuf, klen) ((kbuf)[0] == (item).meta.key[0] && klen == (item).meta.len && memcmp((kbuf), (item).meta.key, (klen)) == 0)
-
-#define hashmap_put_nogrow(hm, value, kbuf, klen) do { \
-    if ((hm).count >= (hm).capacity) abort(); /* This should not happen */ \
-    uint32_t __hashmap_put_nogrow_count = 0; \
-    size_t __hashmap_put_nogrow_mask = HASHMAP_CAP_MASK(hm); \
-    size_t __hashmap_put_nogrow_index = hashmap_hash((uint8_t *)(kbuf), (uint32_t)(klen)) & __hashmap_put_nogrow_mask; \
-    while ((hm).items[__hashmap_put_nogrow_index].meta.used) { \
-        if (hashmap_match_item((hm).items[__hashmap_put_nogrow_index], (kbuf), (klen))) break; \
-        __hashmap_put_nogrow_count += 1; \
-        __hashmap_put_nogrow_index = (__hashmap_put_nogrow_index + 1) & __hashmap_put_nogrow_mask; \
-    } \
-    (hm).items[__hashmap_put_nogrow_index].data = value; \
-    if ((hm).items[__hashmap_put_nogrow_index].meta.used) break; \
-    (hm).items[__hashmap_put_nogrow_index].meta.len = (uint32_t)klen; \
-    (hm).items[__hashmap_put_nogrow_index].meta.key = (uint8_t *)kbuf; \
-    (hm).items[__hashmap_put_nogrow_index].meta.used = 1; \
+#define hashmap_index(hm, kstr, klen) ((hm).index = _HASHMAP_ENTRY((hm), _HASHMAP_LOOKUP((hm), (uint8_t *)(kstr), (klen))), (hm).index)
+#define hashmap_contains(hm, kstr, klen) ((hm).index = _HASHMAP_ENTRY((hm), _HASHMAP_LOOKUP((hm), (uint8_t *)(kstr), (klen))), (hm).index >= 0)
+#define hashmap_match_item(item, kbuf, klen) (klen == (item).meta.len && memcmp((kbuf), _hashmap_meta_key(&(item).meta), (klen)) == 0)
+#define hashmap_probe_histogram(hm, hist, n) _hashmap_probe_histogram(_HASHMAP_TABLE(hm), (hist), (n))
+
+/*
+ * Iteration, in slot order or in insertion order with HASHMAP_ORDERED:
+ *     for (i = hashmap_begin(hm); i < hashmap_end(hm); i = hashmap_next(hm, i)) ...
+ * or hashmap_foreach(hm, i), visits the position of every entry, for hashmap_at and hashmap_meta. Entries may be
+ * removed on the way, except with HASHMAP_ROBIN_HOOD which shifts the next entries back, but not put. With
+ * HASHMAP_INCREMENTAL, hashmap_begin finishes any resize in progress so every entry is in the same table.
+ */
+#ifdef HASHMAP_ORDERED
+#define hashmap_end(hm) ((hm).length)
+#else
+#define hashmap_end(hm) ((hm).capacity)
+#endif /* HASHMAP_ORDERED */
+#define hashmap_begin(hm) (_HASHMAP_FINISH(hm), _hashmap_next(_HASHMAP_TABLE(hm), hashmap_end(hm), 0))
+#define hashmap_next(hm, index) _hashmap_next(_HASHMAP_TABLE(hm), hashmap_end(hm), (size_t)(index) + 1)
+#define hashmap_foreach(hm, index) \
+    for ((index) = hashmap_begin(hm); (size_t)(index) < hashmap_end(hm); (index) = hashmap_next((hm), (index)))
+
+/* insert a key that is known not to be in the hashmap */
+#define hashmap_insert_hash(hm, value, kbuf, klen, khash) do { \
+    if (_HASHMAP_LOAD(hm) >= _HASHMAP_ROOM((hm).capacity)) abort(); /* This should not happen */ \
+    size_t __hashmap_insert_hash_hash = (khash); \
+    size_t __hashmap_insert_hash_slot = _hashmap_claim(_HASHMAP_TABLE(hm), __hashmap_insert_hash_hash, &(hm).tombs); \
+    size_t __hashmap_insert_hash_index = _HASHMAP_PLACE((hm), __hashmap_insert_hash_slot); \
+    hashmap_at((hm), __hashmap_insert_hash_index) = value; \
+    hashmap_meta((hm), __hashmap_insert_hash_index).len = (uint32_t)klen; \
+    _HASHMAP_SET_KEY((hm), __hashmap_insert_hash_index, (const uint8_t *)(kbuf), (uint32_t)(klen)); \
+    hashmap_meta((hm), __hashmap_insert_hash_index).hash = __hashmap_insert_hash_hash; \
+    hashmap_meta((hm), __hashmap_insert_hash_index).used = 1; \
     (hm).count ++; \
-    if ((hm).maxcol < __hashmap_put_nogrow_count) (hm).maxcol = __hashmap_put_nogrow_count; \
 } while (0)
 
-#define hashmap_grow(hm) do { \
-    __typeof__((hm)) __hashmap_grow_tmp = { 0 }; \
-    hashmap_init_cap(__hashmap_grow_tmp, (hm).capacity << 1); \
-    size_t __hashmap_grow_index; \
-    for (__hashmap_grow_index = 0; __hashmap_grow_index < (hm).capacity; __hashmap_grow_index ++) { \
-        if ((hm).items[__hashmap_grow_index].meta.used) { \
-            hashmap_put_nogrow(__hashmap_grow_tmp, (hm).items[__hashmap_grow_index].data, (hm).items[__hashmap_grow_index].meta.key, (hm).items[__hashmap_grow_index].meta.len); \
-        } \
+/* same as hashmap_put_nogrow, for when the hash of the key is already known */
+#define hashmap_put_hash(hm, value, kbuf, klen, khash) do { \
+    size_t __hashmap_put_hash_hash = (khash); \
+    ssize_t __hashmap_put_hash_index = _HASHMAP_ENTRY((hm), _HASHMAP_FIND((hm), __hashmap_put_hash_hash, (uint8_t *)(kbuf), (uint32_t)(klen))); \
+    if (__hashmap_put_hash_index >= 0) { \
+        hashmap_at((hm), __hashmap_put_hash_index) = value; \
+        break; \
+    } \
+    hashmap_insert_hash(hm, value, kbuf, klen, __hashmap_put_hash_hash); \
+} while (0)
+
+#define hashmap_put_nogrow(hm, value, kbuf, klen) \
+    hashmap_put_hash(hm, value, kbuf, klen, HASHMAP_HASH_FN((uint8_t *)(kbuf), (uint32_t)(klen)))
+
+#ifdef HASHMAP_ORDERED
+/* index the entries again in a new table of the given capacity, compacting away the holes and keeping their order */
+#define hashmap_rehash(hm, cap) do { \
+    __typeof__((hm)) __hashmap_rehash_tmp = { 0 }; \
+    _HASHMAP_INHERIT_ARENA(__hashmap_rehash_tmp, hm); \
+    _hashmap_init_cap(__hashmap_rehash_tmp, (cap)); \
+    s_hashmap_table *__hashmap_rehash_to = _HASHMAP_TABLE(__hashmap_rehash_tmp); \
+    size_t __hashmap_rehash_index; \
+    for (__hashmap_rehash_index = 0; __hashmap_rehash_index < (hm).length; __hashmap_rehash_index ++) { \
+        if (!hashmap_meta((hm), __hashmap_rehash_index).used) continue; \
+        __hashmap_rehash_tmp.items[__hashmap_rehash_tmp.length] = (hm).items[__hashmap_rehash_index]; \
+        size_t __hashmap_rehash_slot = _hashmap_claim(__hashmap_rehash_to, hashmap_meta((hm), __hashmap_rehash_index).hash, &__hashmap_rehash_tmp.tombs); \
+        _HASHMAP_PLACE(__hashmap_rehash_tmp, __hashmap_rehash_slot); \
+    } \
+    _HASHMAP_SLOTS_FREE(hm); \
+    _hashmap_free(_HASHMAP_ARENA(hm), (hm).ctrl); \
+    _HASHMAP_SLOTS_TAKE(hm, __hashmap_rehash_tmp); \
+    (hm).ctrl = __hashmap_rehash_tmp.ctrl; \
+    (hm).tombs = 0; \
+    (hm).capacity = __hashmap_rehash_tmp.capacity; \
+} while (0)
+#else
+/* move every entry to a new table of the given capacity, which also drops the deleted slots */
+#define hashmap_rehash(hm, cap) do { \
+    _HASHMAP_FINISH(hm); \
+    __typeof__((hm)) __hashmap_rehash_tmp = { 0 }; \
+    _HASHMAP_INHERIT_ARENA(__hashmap_rehash_tmp, hm); \
+    _hashmap_init_cap(__hashmap_rehash_tmp, (cap)); \
+    s_hashmap_table *__hashmap_rehash_from = _HASHMAP_TABLE(hm); \
+    s_hashmap_table *__hashmap_rehash_to = _HASHMAP_TABLE(__hashmap_rehash_tmp); \
+    size_t __hashmap_rehash_index; \
+    for (__hashmap_rehash_index = 0; __hashmap_rehash_index < (hm).capacity; __hashmap_rehash_index ++) { \
+        if (!_HASHMAP_FULL((hm).ctrl[__hashmap_rehash_index])) continue; \
+        /* entries are moved as they are, keys included */ \
+        size_t __hashmap_rehash_slot = _hashmap_claim(__hashmap_rehash_to, _hashmap_slot_hash(__hashmap_rehash_from, __hashmap_rehash_index), &__hashmap_rehash_tmp.tombs); \
+        _hashmap_slot_copy(__hashmap_rehash_to, __hashmap_rehash_slot, __hashmap_rehash_from, __hashmap_rehash_index); \
     } \
-    hashmap_deinit((hm)); \
-    (hm).items = __hashmap_grow_tmp.items; \
-    (hm).count = __hashmap_grow_tmp.count; \
-    (hm).maxcol = __hashmap_grow_tmp.maxcol; \
-    (hm).capacity = __hashmap_grow_tmp.capacity; \
+    _HASHMAP_SLOTS_FREE(hm); \
+    _hashmap_free(_HASHMAP_ARENA(hm), (hm).ctrl); \
+    _HASHMAP_SLOTS_TAKE(hm, __hashmap_rehash_tmp); \
+    (hm).ctrl = __hashmap_rehash_tmp.ctrl; \
+    (hm).tombs = 0; \
+    (hm).capacity = __hashmap_rehash_tmp.capacity; \
 } while (0)
+#endif /* HASHMAP_ORDERED */
+
+#define hashmap_grow(hm) hashmap_rehash(hm, (hm).capacity << 1)
 
 #define hashmap_shrink(hm) do { \
     /* do not shrink if the current occupation is more than 1/4 of the capacity */ \
-    if ((hm).count > (hm).capacity / 4) break; \
-    __typeof__((hm)) __hashmap_shrink_tmp = { 0 }; \
-    hashmap_init_cap(__hashmap_shrink_tmp, (hm).capacity >> 1); \
-    size_t __hashmap_shrink_index; \
-    for (__hashmap_shrink_index = 0; __hashmap_shrink_index < (hm).count; __hashmap_shrink_index ++) { \
-        if ((hm).items[__hashmap_shrink_index].meta.used) { \
-            hashmap_put_nogrow(__hashmap_shrink_tmp, (hm).items[__hashmap_shrink_index].data, (hm).items[__hashmap_shrink_index].meta.key, (hm).items[__hashmap_shrink_index].meta.len); \
-        } \
+    if ((hm).count > (hm).capacity / 4 || (hm).capacity <= HASHMAP_GROUP) break; \
+    hashmap_rehash(hm, (hm).capacity >> 1); \
+} while (0)
+
+/*
+ * Group probing keeps probes short up to a load factor of 7/8, counting deleted slots. Past that the
+ * table grows, unless it is mostly deleted slots, in which case they are dropped at the same size.
+ */
+#define _hashmap_make_room(hm) do { \
+    if (_HASHMAP_LOAD(hm) * 8 >= (hm).capacity * 7) { \
+        _hashmap_resize((hm), (hm).count * 2 >= (hm).capacity ? (hm).capacity << 1 : (hm).capacity); \
     } \
-    hashmap_deinit((hm)); \
-    (hm).items = __hashmap_shrink_tmp.items; \
-    (hm).count = __hashmap_shrink_tmp.count; \
-    (hm).maxcol = __hashmap_shrink_tmp.maxcol; \
-    (hm).capacity = __hashmap_shrink_tmp.capacity; \
 } while (0)
 
 #define hashmap_put(hm, value, kbuf, klen) do { \
-    /* calculate the load factor. If bigger than 0.7, we increase the hashmap's capacity and reinsert everything */ \
-    if ((double)(hm).count / (double)(hm).capacity >= 0.7) { \
-        hashmap_grow((hm)); \
-    } \
+    _hashmap_make_room(hm); \
     hashmap_put_nogrow((hm), (value), (kbuf), (klen)); \
 } while (0)
 
 #define hashmap_remove(hm, kbuf, klen) do { \
-    /* this will leave a gap on the item buffer */ \
-    ssize_t __hashmap_remove_index = -1; \
-    hashmap_index_var((hm), __hashmap_remove_index, (kbuf), (klen)); \
-    if (__hashmap_remove_index >= 0) { \
-        (hm).items[__hashmap_remove_index].meta.used = 0; /* lazy removal */ \
+    ssize_t __hashmap_remove_slot = _HASHMAP_LOOKUP((hm), (uint8_t *)(kbuf), (klen)); \
+    if (__hashmap_remove_slot >= 0) { \
+        ssize_t __hashmap_remove_index = _HASHMAP_ENTRY((hm), __hashmap_remove_slot); \
+        _HASHMAP_DROP_KEY((hm), __hashmap_remove_index); \
+        hashmap_meta((hm), __hashmap_remove_index).used = 0; /* a hole, with HASHMAP_ORDERED */ \
+        _hashmap_erase(_HASHMAP_TABLE(hm), (size_t)__hashmap_remove_slot, &(hm).tombs); \
+        (hm).count --; \
+    } \
+} while (0)
+
+/*
+ * Integer keys: MAKE_HASHMAP_U64 stores a uint64_t key in place of the metadata of a slot. It is compared directly
+ * and hashed again with HASHMAP_U64_HASH_FN when the table is resized, instead of keeping a stored hash, a length
+ * and a key pointer per slot. hashmap_init, hashmap_init_cap, hashmap_at, hashmap_avail, hashmap_rehash,
+ * hashmap_grow, hashmap_shrink, hashmap_probe_histogram and the iteration macros work on both kinds of map.
+ */
+#ifndef HASHMAP_ORDERED
+#ifdef HASHMAP_SOA
+#define _HASHMAP_U64_SLOTS(type) \
+    uint64_t *meta;              /* key of each slot */ \
+    type *data                   /* value of each slot */
+#else
+#define _HASHMAP_U64_SLOTS(type) \
+    struct { \
+        uint64_t meta;           /* key of the entry */ \
+        type data;               /* the actual data that this entry holds */ \
+    } *items
+#endif /* HASHMAP_SOA */
+
+#define MAKE_HASHMAP_U64(type) \
+    size_t count;                /* number of occupied entries */ \
+    ssize_t index;               /* used when searching for a key */ \
+    size_t capacity;             /* Total capacity of the hashmap, will grow as needed */ \
+    size_t tombs;                /* number of deleted slots, they count towards the load factor */ \
+    uint8_t *ctrl;               /* control byte of each slot */ \
+    _HASHMAP_OLD_FIELD \
+    _HASHMAP_ARENA_FIELD \
+    _HASHMAP_U64_SLOTS(type)
+
+#ifdef HASHMAP_ROBIN_HOOD
+static inline ssize_t _hashmap_u64_find(const s_hashmap_table *t, size_t hash, uint64_t key) {
+    size_t mask = t->capacity - 1;
+    size_t index = hash & mask;
+    size_t distance = 0;
+    while (t->ctrl[index] != HASHMAP_CTRL_EMPTY && _hashmap_probe_length(t, index) >= distance) {
+        if (_hashmap_slot_key(t, index) == key) return index;
+        index = (index + 1) & mask;
+        distance ++;
+    }
+    return -1;
+}
+#else
+static inline ssize_t _hashmap_u64_find(const s_hashmap_table *t, size_t hash, uint64_t key) {
+    size_t mask = t->capacity - 1;
+    size_t pos = hash & mask & ~(HASHMAP_GROUP - 1);
+    size_t step = 0;
+    uint8_t tag = _HASHMAP_H2(hash);
+    while (step < t->capacity) {
+        uint32_t match = _hashmap_group_match(t->ctrl + pos, tag);
+        while (match) {
+            size_t index = pos + (size_t)__builtin_ctz(match);
+            if (_hashmap_slot_key(t, index) == key) return index;
+            match &= match - 1;
+        }
+        if (_hashmap_group_match(t->ctrl + pos, HASHMAP_CTRL_EMPTY)) break;
+        step += HASHMAP_GROUP;
+        pos = (pos + step) & mask;
+    }
+    return -1;
+}
+#endif /* HASHMAP_ROBIN_HOOD */
+
+static inline ssize_t hashmap_u64_lookup(const s_hashmap_table *t, uint64_t key) {
+    if (!t->meta) return -1;
+    return _hashmap_u64_find(t, HASHMAP_U64_HASH_FN(key), key);
+}
+
+#ifdef HASHMAP_INCREMENTAL
+static inline ssize_t _hashmap_u64_find_incremental(s_hashmap_old *old, const s_hashmap_table *t, size_t *tombs, size_t hash, uint64_t key) {
+    _hashmap_migrate(old, t, tombs, HASHMAP_MIGRATE_STEP);
+    ssize_t index = _hashmap_u64_find(t, hash, key);
+    if (index >= 0 || old->ctrl == NULL) return index;
+    s_hashmap_table from = _hashmap_old_table(old, t);
+    index = _hashmap_u64_find(&from, hash, key);
+    if (index < 0) return -1;
+    return _hashmap_migrate_slot(old, index, t, tombs);
+}
+
+static inline ssize_t hashmap_u64_lookup_incremental(s_hashmap_old *old, const s_hashmap_table *t, size_t *tombs, uint64_t key) {
+    if (!t->meta) return -1;
+    return _hashmap_u64_find_incremental(old, t, tombs, HASHMAP_U64_HASH_FN(key), key);
+}
+
+#define _HASHMAP_U64_FIND(hm, khash, key) \
+    _hashmap_u64_find_incremental(&(hm).old, _HASHMAP_TABLE(hm), &(hm).tombs, (khash), (key))
+#define _HASHMAP_U64_LOOKUP(hm, key) \
+    hashmap_u64_lookup_incremental(&(hm).old, _HASHMAP_TABLE(hm), &(hm).tombs, (key))
+#else
+#define _HASHMAP_U64_FIND(hm, khash, key) _hashmap_u64_find(_HASHMAP_TABLE(hm), (khash), (key))
+#define _HASHMAP_U64_LOOKUP(hm, key) hashmap_u64_lookup(_HASHMAP_TABLE(hm), (key))
+#endif /* HASHMAP_INCREMENTAL */
+
+#define hashmap_u64_key(hm, index) hashmap_meta((hm), (index))
+#define hashmap_u64_deinit(hm) _hashmap_deinit_table(hm)
+#define hashmap_u64_get(hm, key) ((hm).index = _HASHMAP_U64_LOOKUP((hm), (uint64_t)(key)), hashmap_at((hm), (hm).index))
+#define hashmap_u64_index(hm, key) ((hm).index = _HASHMAP_U64_LOOKUP((hm), (uint64_t)(key)), (hm).index)
+#define hashmap_u64_contains(hm, key) ((hm).index = _HASHMAP_U64_LOOKUP((hm), (uint64_t)(key)), (hm).index >= 0)
+
+#define hashmap_u64_put_nogrow(hm, value, key) do { \
+    uint64_t __hashmap_u64_put_key = (uint64_t)(key); \
+    size_t __hashmap_u64_put_hash = HASHMAP_U64_HASH_FN(__hashmap_u64_put_key); \
+    if ((hm).count + (hm).tombs >= (hm).capacity) abort(); /* This should not happen */ \
+    ssize_t __hashmap_u64_put_index = _HASHMAP_U64_FIND((hm), __hashmap_u64_put_hash, __hashmap_u64_put_key); \
+    if (__hashmap_u64_put_index < 0) { \
+        __hashmap_u64_put_index = (ssize_t)_hashmap_claim(_HASHMAP_TABLE(hm), __hashmap_u64_put_hash, &(hm).tombs); \
+        hashmap_u64_key((hm), __hashmap_u64_put_index) = __hashmap_u64_put_key; \
+        (hm).count ++; \
+    } \
+    hashmap_at((hm), __hashmap_u64_put_index) = value; \
+} while (0)
+
+#define hashmap_u64_put(hm, value, key) do { \
+    _hashmap_make_room(hm); \
+    hashmap_u64_put_nogrow((hm), (value), (key)); \
+} while (0)
+
+#define hashmap_u64_remove(hm, key) do { \
+    ssize_t __hashmap_u64_remove_index = hashmap_u64_index((hm), (key)); \
+    if (__hashmap_u64_remove_index >= 0) { \
+        _hashmap_erase(_HASHMAP_TABLE(hm), (size_t)__hashmap_u64_remove_index, &(hm).tombs); \
         (hm).count --; \
     } \
 } while (0)
+#endif /* HASHMAP_ORDERED */
 
 #endif /* hashmap.h */
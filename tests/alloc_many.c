@@ -0,0 +1,56 @@
+/* arena_alloc_many gives each object its own block, arena_alloc_array one block for the whole array */
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define HDR sizeof(struct _arena_alloc_header)
+
+static void test_many(void) {
+    p_arena arena = {0};
+    void *ptrs[100];
+    size_t i;
+
+    arena_init(arena);
+    size_t offset = arena->head->offset;
+    arena_alloc_many(arena, 100, 24, ptrs);
+    assert(arena->head->offset == offset + 100 * (HDR + 24));
+    for (i = 0; i < 100; i ++) {
+        assert(((struct _arena_alloc_header *)((char *)ptrs[i] - HDR))->size == 24);
+        if (i > 0) assert((char *)ptrs[i] == (char *)ptrs[i - 1] + HDR + 24);
+        memset(ptrs[i], (int)i, 24);
+    }
+    for (i = 0; i < 100; i ++) assert(((unsigned char *)ptrs[i])[23] == i);
+
+    /* each object is a block of its own, so the last one can be freed */
+    arena_free(arena, ptrs[99]);
+    assert(arena->head->offset == offset + 99 * (HDR + 24));
+
+    /* a batch that doesn't fit in the region goes to a new one as a whole */
+    void *more[1000];
+    arena_alloc_many(arena, 1000, 24, more);
+    assert(arena->tail != arena->head);
+    assert((char *)more[0] == arena->tail->mem + HDR && (char *)more[999] == arena->tail->mem + 999 * (HDR + 24) + HDR);
+
+    arena_alloc_many(arena, 0, 24, NULL);
+    arena_deinit(arena);
+}
+
+static void test_array(void) {
+    p_arena arena = {0};
+    size_t i;
+
+    arena_init(arena);
+    size_t offset = arena->head->offset;
+    int *array = arena_alloc_array(arena, 100, sizeof(int));
+    assert(arena->head->offset == offset + HDR + 100 * sizeof(int));
+    for (i = 0; i < 100; i ++) array[i] = (int)i;
+    for (i = 0; i < 100; i ++) assert(array[i] == (int)i);
+    arena_deinit(arena);
+}
+
+int main(void) {
+    test_many();
+    test_array();
+    printf("alloc_many: ok\n");
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Hashmap grow and miss benchmark, with long keys sharing a prefix: time hashmap_grow, which places entries by
+ * their cached hash, against putting every key into a new map, which hashes them again, then time lookups that
+ * hit and lookups that all miss, where the cached hash saves comparing the keys.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "hashmap.h"
+
+#define N 200000
+#define KEYLEN 64
+#define ROUNDS 5
+
+typedef struct { MAKE_HASHMAP(size_t); } map;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    /* the first N keys are put, the next N only looked up */
+    char *keys = malloc((size_t)2 * N * KEYLEN);
+    double grow = 0, reput = 0, hit = 0, miss = 0, start;
+    size_t found = 0, i, r;
+
+    for (i = 0; i < 2 * N; i ++) {
+        memset(keys + i * KEYLEN, 'k', KEYLEN);
+        snprintf(keys + i * KEYLEN + KEYLEN - 16, 16, "%015zu", i);
+    }
+
+    for (r = 0; r < ROUNDS; r ++) {
+        map m = { 0 }, copy = { 0 };
+        hashmap_init(m);
+        for (i = 0; i < N; i ++) hashmap_put(m, i, keys + i * KEYLEN, KEYLEN);
+
+        start = now();
+        hashmap_init_cap(copy, m.capacity << 1);
+        for (i = 0; i < N; i ++) hashmap_put_nogrow(copy, i, keys + i * KEYLEN, KEYLEN);
+        reput += now() - start;
+        start = now();
+        hashmap_grow(m);
+        grow += now() - start;
+
+        start = now();
+        for (i = 0; i < N; i ++) found += hashmap_contains(m, keys + i * KEYLEN, KEYLEN);
+        hit += now() - start;
+        start = now();
+        for (i = N; i < 2 * N; i ++) found += hashmap_contains(m, keys + i * KEYLEN, KEYLEN);
+        miss += now() - start;
+
+        hashmap_deinit(copy);
+        hashmap_deinit(m);
+    }
+
+    printf("grow:   %8.2f ms, put again: %8.2f ms\n", grow * 1e3 / ROUNDS, reput * 1e3 / ROUNDS);
+    printf("hits:   %8.2f ns, misses:    %8.2f ns per lookup\n", hit * 1e9 / ROUNDS / N, miss * 1e9 / ROUNDS / N);
+    if (found != (size_t)ROUNDS * N) return 1;
+    free(keys);
+    return 0;
+}
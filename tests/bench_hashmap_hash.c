@@ -0,0 +1,83 @@
+/*
+ * Hashmap hash benchmark: time hashmap_hash against hashmap_hash_fnv1 over keys of growing length, then fill a
+ * map to its load factor with similar keys using each of them and print how far the entries are from home.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* the hash of the map is picked at run time, to compare both with the same build */
+static size_t (*bench_hash)(const uint8_t *str, uint32_t len);
+#define HASHMAP_HASH_FN bench_hash
+#include "hashmap.h"
+
+#define BYTES (64u << 20)
+#define KEYS ((size_t)7 << 17)
+#define BUCKETS 8
+
+typedef struct { MAKE_HASHMAP(size_t); } map;
+
+static const struct {
+    const char *name;
+    size_t (*fn)(const uint8_t *str, uint32_t len);
+} hashes[] = {
+    { "hashmap_hash", hashmap_hash },
+    { "hashmap_hash_fnv1", hashmap_hash_fnv1 },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void throughput(const uint8_t *buf) {
+    static const uint32_t lengths[] = { 4, 8, 16, 32, 64, 256, 4096 };
+    size_t h, l, i, sum = 0;
+
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l ++) {
+        printf("%4u bytes:", lengths[l]);
+        for (h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h ++) {
+            size_t n = BYTES / lengths[l];
+            double start = now(), time;
+            /* the offset varies so the loads are not all aligned, and each key depends on the last hash */
+            for (i = 0; i < n; i ++) sum += hashes[h].fn(buf + (i & 7) + (sum & 8), lengths[l]);
+            time = now() - start;
+            printf("  %s %6.2f ns %6.2f GB/s", hashes[h].name, time * 1e9 / n, BYTES / time * 1e-9);
+        }
+        printf("\n");
+    }
+    if (sum == 0) printf("\n");
+}
+
+static void probes(void) {
+    size_t h, i, longest, hist[BUCKETS];
+    char key[32];
+
+    for (h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h ++) {
+        map m = { 0 };
+        bench_hash = hashes[h].fn;
+        /* KEYS is 7/8 of a power of 2, the most the map holds without growing */
+        hashmap_init_cap(m, KEYS / 7 * 8);
+        for (i = 0; i < KEYS; i ++) {
+            int len = snprintf(key, sizeof(key), "user:%zu", i);
+            hashmap_put(m, i, key, len);
+        }
+        longest = hashmap_probe_histogram(m, hist, BUCKETS);
+        printf("%-18s probe lengths:", hashes[h].name);
+        for (i = 0; i < BUCKETS; i ++) printf(" %zu%s", hist[i], i == BUCKETS - 1 ? "+" : "");
+        printf(", longest %zu\n", longest);
+        hashmap_deinit(m);
+    }
+}
+
+int main(void) {
+    uint8_t *buf = malloc(4096 + 16);
+    size_t i;
+
+    for (i = 0; i < 4096 + 16; i ++) buf[i] = (uint8_t)(i * 131);
+    throughput(buf);
+    probes();
+    free(buf);
+    return 0;
+}
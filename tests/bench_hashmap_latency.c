@@ -0,0 +1,53 @@
+/*
+ * Hashmap put latency benchmark: time every put while a map grows from empty and print the percentiles. Built
+ * twice, see Makefile: the plain build moves the whole table on the puts that grow it, the HASHMAP_INCREMENTAL
+ * one spreads that work over the puts that follow.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "hashmap.h"
+
+#define N ((size_t)4 << 20)
+
+typedef struct { MAKE_HASHMAP(size_t); } map;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(void) {
+    uint64_t *keys = malloc(N * sizeof(*keys)), start, total;
+    uint32_t *lat = malloc(N * sizeof(*lat));
+    map m = { 0 };
+    size_t i;
+
+    for (i = 0; i < N; i ++) keys[i] = i * 0x9E3779B97F4A7C15ull;
+    hashmap_init(m);
+    total = now_ns();
+    for (i = 0; i < N; i ++) {
+        start = now_ns();
+        hashmap_put(m, i, &keys[i], sizeof(*keys));
+        lat[i] = (uint32_t)(now_ns() - start);
+    }
+    total = now_ns() - total;
+    qsort(lat, N, sizeof(*lat), compare);
+
+#ifdef HASHMAP_INCREMENTAL
+    printf("incremental: ");
+#else
+    printf("whole table: ");
+#endif /* HASHMAP_INCREMENTAL */
+    printf("%.2f s, p50 %u ns, p99 %u ns, p999 %u ns, max %u ns\n", total * 1e-9,
+        lat[N / 2], lat[N - N / 100], lat[N - N / 1000], lat[N - 1]);
+    hashmap_deinit(m);
+    free(keys);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Hashmap load factor benchmark: fill a table of fixed capacity to rising load factors, up to the 7/8 it grows
+ * at, and time lookups that hit and lookups that miss at each one. Build with -DHASHMAP_NO_SIMD to compare
+ * against probing the control bytes one at a time.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "hashmap.h"
+
+#define CAPACITY ((size_t)1 << 18)
+#define ROUNDS 5
+
+typedef struct { MAKE_HASHMAP(size_t); } map;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    /* the first CAPACITY keys are put, the next CAPACITY only looked up */
+    uint64_t *keys = malloc(2 * CAPACITY * sizeof(*keys));
+    size_t eighths, found = 0, expect = 0, i, r;
+
+    for (i = 0; i < 2 * CAPACITY; i ++) keys[i] = i * 0x9E3779B97F4A7C15ull;
+
+    for (eighths = 4; eighths <= 7; eighths ++) {
+        size_t n = CAPACITY * eighths / 8;
+        double hit = 0, miss = 0, start;
+        map m = { 0 };
+        hashmap_init_cap(m, CAPACITY);
+        for (i = 0; i < n; i ++) hashmap_put_nogrow(m, i, &keys[i], sizeof(*keys));
+
+        for (r = 0; r < ROUNDS; r ++) {
+            start = now();
+            for (i = 0; i < n; i ++) found += hashmap_contains(m, &keys[i], sizeof(*keys));
+            hit += now() - start;
+            start = now();
+            for (i = CAPACITY; i < CAPACITY + n; i ++) found += hashmap_contains(m, &keys[i], sizeof(*keys));
+            miss += now() - start;
+            expect += n;
+        }
+        printf("load %zu/8: hits %6.2f ns, misses %6.2f ns per lookup\n", eighths, hit * 1e9 / ROUNDS / n, miss * 1e9 / ROUNDS / n);
+        hashmap_deinit(m);
+    }
+
+    if (found != expect) return 1;
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Integer key benchmark: put, hit and miss the same uint64_t keys in a MAKE_HASHMAP_U64 map and in a byte keyed
+ * map holding pointers to them, which hashes and compares 8 bytes behind a pointer instead.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "hashmap.h"
+
+#define N ((size_t)1 << 20)
+#define ROUNDS 3
+
+typedef struct { MAKE_HASHMAP_U64(size_t); } u64_map;
+typedef struct { MAKE_HASHMAP(size_t); } map;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double put, double hit, double miss) {
+    printf("%-10s put %6.2f ns, hit %6.2f ns, miss %6.2f ns\n", name,
+        put * 1e9 / ROUNDS / N, hit * 1e9 / ROUNDS / N, miss * 1e9 / ROUNDS / N);
+}
+
+int main(void) {
+    /* the first N keys are put, the next N only looked up */
+    uint64_t *keys = malloc(2 * N * sizeof(*keys));
+    double put = 0, hit = 0, miss = 0, start;
+    size_t found = 0, i, r;
+
+    for (i = 0; i < 2 * N; i ++) keys[i] = i * 0x9E3779B97F4A7C15ull;
+
+    for (r = 0; r < ROUNDS; r ++) {
+        u64_map m = { 0 };
+        hashmap_init(m);
+        start = now();
+        for (i = 0; i < N; i ++) hashmap_u64_put(m, i, keys[i]);
+        put += now() - start;
+        start = now();
+        for (i = 0; i < N; i ++) found += hashmap_u64_contains(m, keys[i]);
+        hit += now() - start;
+        start = now();
+        for (i = N; i < 2 * N; i ++) found += hashmap_u64_contains(m, keys[i]);
+        miss += now() - start;
+        hashmap_u64_deinit(m);
+    }
+    report("u64 keys", put, hit, miss);
+
+    put = hit = miss = 0;
+    for (r = 0; r < ROUNDS; r ++) {
+        map m = { 0 };
+        hashmap_init(m);
+        start = now();
+        for (i = 0; i < N; i ++) hashmap_put(m, i, &keys[i], sizeof(*keys));
+        put += now() - start;
+        start = now();
+        for (i = 0; i < N; i ++) found += hashmap_contains(m, &keys[i], sizeof(*keys));
+        hit += now() - start;
+        start = now();
+        for (i = N; i < 2 * N; i ++) found += hashmap_contains(m, &keys[i], sizeof(*keys));
+        miss += now() - start;
+        hashmap_deinit(m);
+    }
+    report("byte keys", put, hit, miss);
+
+    if (found != 2 * ROUNDS * N) return 1;
+    free(keys);
+    return 0;
+}
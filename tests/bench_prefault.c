@@ -0,0 +1,64 @@
+/*
+ * Prefault latency benchmark: time requests that allocate a fresh block and write all of it, with the pages
+ * faulted in on first touch, by ARENA_PREFAULT when the region is created, or by arena_prefault between requests,
+ * and print the latency histogram of each.
+ */
+#include <stdio.h>
+#include <time.h>
+#define ARENA_MMAP_BACKEND
+#include "arena.h"
+
+#define REQUESTS 4096
+#define REQUEST_SIZE (16 * 1024)
+#define BUCKETS 24
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, unsigned long long *latency) {
+    size_t hist[BUCKETS] = {0}, i;
+    for (i = 0; i < REQUESTS; i ++) {
+        size_t bucket = 0;
+        while (bucket < BUCKETS - 1 && latency[i] >> (bucket + 1)) bucket ++;
+        hist[bucket] ++;
+    }
+    qsort(latency, REQUESTS, sizeof(*latency), compare);
+    printf("%s: p50 %llu p99 %llu p999 %llu max %llu ns\n", name, latency[REQUESTS / 2],
+           latency[REQUESTS * 99 / 100], latency[REQUESTS * 999 / 1000], latency[REQUESTS - 1]);
+    for (i = 0; i < BUCKETS; i ++) {
+        if (hist[i]) printf("  < %8lu ns: %lu\n", 2ul << i, hist[i]);
+    }
+}
+
+/* mode 0: fault on first touch, 1: ARENA_PREFAULT, 2: arena_prefault between requests */
+static void run(const char *name, int mode) {
+    static unsigned long long latency[REQUESTS];
+    p_arena arena = {0};
+    size_t i;
+
+    arena_init_flags(arena, mode == 1 ? ARENA_PREFAULT : 0);
+    for (i = 0; i < REQUESTS; i ++) {
+        if (mode == 2) arena_prefault(arena, sizeof(struct _arena_alloc_header) + REQUEST_SIZE);
+        unsigned long long start = now_ns();
+        char *block = arena_alloc(arena, REQUEST_SIZE);
+        memset(block, (int)i, REQUEST_SIZE);
+        latency[i] = now_ns() - start;
+    }
+    arena_deinit(arena);
+    report(name, latency);
+}
+
+int main(void) {
+    run("first touch", 0);
+    run("ARENA_PREFAULT", 1);
+    run("arena_prefault between requests", 2);
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Growth/shrink benchmark: build buffers by over-reserving and trimming them, and by growing them a chunk at a
+ * time, and report the time and the bytes the arena ends up using.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "arena.h"
+
+#define BUFFERS 100000
+#define RESERVE 4096
+#define CHUNK 64
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    p_arena arena = {0};
+    size_t i, j, used = 0;
+    double start;
+
+    /* reserve RESERVE bytes, use a few hundred of them and trim the buffer to what was used */
+    start = now();
+    for (i = 0; i < BUFFERS; i ++) {
+        char *buf = arena_alloc(arena, RESERVE);
+        size_t len = 100 + i % 400;
+        memset(buf, 'x', len);
+        buf = arena_realloc(arena, buf, len);
+        used += len;
+    }
+    printf("shrink: %.3fs, %lu bytes used, %lu bytes in the arena\n", now() - start, used, arena->total);
+    arena_deinit(arena);
+
+    /* grow each buffer CHUNK bytes at a time, in place as long as it is the last block */
+    used = 0;
+    start = now();
+    for (i = 0; i < BUFFERS / 10; i ++) {
+        char *buf = NULL;
+        size_t len = 0;
+        for (j = 0; j < 16 + i % 32; j ++) {
+            buf = arena_realloc(arena, buf, len + CHUNK);
+            memset(buf + len, 'x', CHUNK);
+            len += CHUNK;
+        }
+        used += len;
+    }
+    printf("grow:   %.3fs, %lu bytes used, %lu bytes in the arena\n", now() - start, used, arena->total);
+    arena_deinit(arena);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Streaming copy benchmark: clone a large payload between passes over a hot working set, with arena_memclone
+ * (non-temporal stores) and with a plain memcpy into the arena, and time the copies and the passes after them.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "arena.h"
+
+#define PAYLOAD (8u << 20)
+#define WORKING_SET (256u << 10)
+#define ROUNDS 64
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t pass(const size_t *hot, size_t n) {
+    size_t sum = 0, i;
+    for (i = 0; i < n; i ++) sum += hot[i];
+    return sum;
+}
+
+static void run(const char *name, int stream, const char *payload, const size_t *hot) {
+    double copy = 0, after = 0, start;
+    size_t sum = 0, i;
+
+    for (i = 0; i < ROUNDS; i ++) {
+        p_arena arena = {0};
+        sum += pass(hot, WORKING_SET / sizeof(*hot));
+        start = now();
+        if (stream) arena_memclone(arena, payload, PAYLOAD);
+        else memcpy(arena_alloc(arena, PAYLOAD), payload, PAYLOAD);
+        copy += now() - start;
+        start = now();
+        sum += pass(hot, WORKING_SET / sizeof(*hot));
+        after += now() - start;
+        arena_deinit(arena);
+    }
+    printf("%-14s copy %.3f ms, working set pass after it %.1f us (%lu)\n", name, copy * 1e3 / ROUNDS,
+           after * 1e6 / ROUNDS, sum & 1);
+}
+
+int main(void) {
+    char *payload = malloc(PAYLOAD);
+    size_t *hot = malloc(WORKING_SET), i;
+
+    memset(payload, 'p', PAYLOAD);
+    for (i = 0; i < WORKING_SET / sizeof(*hot); i ++) hot[i] = i;
+
+    run("memcpy", 0, payload, hot);
+    run("arena_memclone", 1, payload, hot);
+    free(payload);
+    free(hot);
+    return 0;
+}
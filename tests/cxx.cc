@@ -0,0 +1,94 @@
+/*
+ * The C++ Arena destroys what make() created in reverse order, on reset, rewind and destruction, and ScratchScope
+ * rewinds a per-thread scratch arena that doesn't conflict with the ones passed to it.
+ */
+#include <cassert>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+
+static std::vector<int> destroyed;
+
+struct Tracked {
+    int id;
+    explicit Tracked(int id) : id(id) {}
+    ~Tracked() { destroyed.push_back(id); }
+};
+
+struct alignas(64) Wide {
+    char bytes[64];
+};
+
+static void test_finalizers() {
+    {
+        arena::Arena arena;
+        for (int i = 0; i < 5; i ++) assert(arena.make<Tracked>(i)->id == i);
+        arena.reset();
+        assert((destroyed == std::vector<int>{4, 3, 2, 1, 0}));
+
+        destroyed.clear();
+        arena.make<Tracked>(10);
+        arena::Arena::Mark mark = arena.mark();
+        arena.make<Tracked>(11);
+        arena.make<Tracked>(12);
+        arena.rewind(mark);
+        assert((destroyed == std::vector<int>{12, 11}));
+        destroyed.clear();
+    }
+    assert((destroyed == std::vector<int>{10}));
+    destroyed.clear();
+}
+
+static void test_alignment() {
+    arena::Arena arena;
+    for (int i = 0; i < 10; i ++) {
+        arena.make<char>('x');
+        assert(reinterpret_cast<size_t>(arena.make<Wide>()) % 64 == 0);
+        assert(reinterpret_cast<size_t>(arena.make<double>(1.0)) % alignof(double) == 0);
+        assert(reinterpret_cast<size_t>(arena.alloc(3)) % alignof(std::max_align_t) == 0);
+    }
+}
+
+/* builds its result in `out`, with temporaries in a scratch arena that must not be `out` */
+static int *build(arena::Arena &out, int value) {
+    arena::ScratchScope scratch(&out);
+    assert(&scratch.arena() != &out);
+    scratch->make<Tracked>(100 + value);
+    return out.make<int>(value);
+}
+
+static void test_scratch() {
+    arena::Arena *first;
+    size_t offset;
+    {
+        arena::ScratchScope scope;
+        first = &scope.arena();
+        offset = first->get()->tail ? first->get()->tail->offset : 0;
+        scope->make<Tracked>(1);
+        scope->alloc(1000);
+
+        /* the scratch arena of a callee building its result in ours is the other one */
+        int *result = build(scope.arena(), 2);
+        assert(*result == 2);
+        assert((destroyed == std::vector<int>{102}));
+        assert(&arena::scratch(first) != first);
+    }
+    assert((destroyed == std::vector<int>{102, 1}));
+    assert(first->get()->tail->offset == offset);
+    destroyed.clear();
+
+    /* each thread has its own scratch arenas */
+    arena::Arena *other = nullptr;
+    std::thread thread([&other] { other = &arena::scratch(); });
+    thread.join();
+    assert(other != nullptr && other != first);
+}
+
+int main() {
+    test_finalizers();
+    test_alignment();
+    test_scratch();
+    std::printf("cxx: ok\n");
+    return 0;
+}
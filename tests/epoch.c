@@ -0,0 +1,78 @@
+/* retired versions are kept while a reader that could see them is inside, and released once it leaves */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define READERS 2
+#define VERSIONS 2000
+
+static p_arena_epoch epoch;
+static int done;
+
+static size_t *publish(size_t value) {
+    s_arena *arena = arena_epoch_begin(epoch);
+    size_t *root = arena_alloc(arena, 2 * sizeof(size_t));
+    root[0] = value;
+    root[1] = ~value;
+    arena_epoch_publish(epoch, arena, root);
+    return root;
+}
+
+static void test_reclaim(void) {
+    arena_epoch_init(epoch);
+    size_t *first = publish(1);
+    size_t slot = arena_epoch_register(epoch);
+
+    assert(arena_epoch_enter(epoch, slot) == first);
+    publish(2);
+    /* the reader entered before the second version, the first one must stay */
+    assert(epoch->retired != NULL);
+    assert(first[0] == 1 && first[1] == ~(size_t)1);
+
+    arena_epoch_leave(epoch, slot);
+    arena_epoch_reclaim(epoch);
+    assert(epoch->retired == NULL);
+
+    /* readers outside don't hold anything back */
+    publish(3);
+    assert(epoch->retired == NULL);
+
+    arena_epoch_deinit(epoch);
+}
+
+static void *reader(void *arg) {
+    size_t slot = arena_epoch_register(epoch), last = 0;
+    (void)arg;
+    while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        size_t *root = arena_epoch_enter(epoch, slot);
+        assert(root[1] == ~root[0]);
+        assert(root[0] >= last);
+        last = root[0];
+        arena_epoch_leave(epoch, slot);
+    }
+    return NULL;
+}
+
+static void test_readers(void) {
+    pthread_t threads[READERS];
+    size_t i;
+
+    arena_epoch_init(epoch);
+    publish(0);
+    for (i = 0; i < READERS; i ++) pthread_create(&threads[i], NULL, reader, NULL);
+    for (i = 1; i <= VERSIONS; i ++) publish(i);
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < READERS; i ++) pthread_join(threads[i], NULL);
+
+    arena_epoch_reclaim(epoch);
+    assert(epoch->retired == NULL);
+    arena_epoch_deinit(epoch);
+}
+
+int main(void) {
+    test_reclaim();
+    test_readers();
+    printf("epoch: ok\n");
+    return 0;
+}
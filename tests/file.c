@@ -0,0 +1,75 @@
+/* a file arena keeps its contents and its root across close and reopen, and can be opened read-only */
+#define ARENA_MMAP_BACKEND
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+struct node {
+    arena_relptr    next;
+    size_t          value;
+};
+
+static char path[64];
+
+static size_t sum(struct node *node) {
+    size_t total = 0;
+    for (; node; node = arena_relptr_get(node->next, struct node)) total += node->value;
+    return total;
+}
+
+/* prepend count nodes, from 1 to count, to the list at the root */
+static void append(p_arena arena, size_t count) {
+    struct node *head = arena_file_root(arena);
+    size_t i;
+    for (i = 1; i <= count; i ++) {
+        struct node *node = arena_alloc(arena, sizeof(*node));
+        node->value = i;
+        arena_relptr_set(node->next, head);
+        head = node;
+    }
+    arena_file_set_root(arena, head);
+}
+
+int main(void) {
+    p_arena arena = {0}, reader = {0};
+
+    snprintf(path, sizeof(path), "/tmp/arena-file-%d", (int)getpid());
+    unlink(path);
+
+    assert(arena_file_open(arena, path, 0) == 0);
+    assert(arena_file_root(arena) == NULL);
+    append(arena, 100);
+    assert(sum(arena_file_root(arena)) == 5050);
+    arena_deinit(arena);
+
+    /* reopened, the list is still there and grows across regions */
+    assert(arena_file_open(arena, path, ARENA_FILE_SYNC) == 0);
+    assert(sum(arena_file_root(arena)) == 5050);
+    append(arena, 10000);
+    assert(arena->head != arena->tail);
+    assert(arena_file_sync(arena, 0) == 0);
+
+    /* a reader can map it while the writer has it open */
+    assert(arena_file_open(reader, path, ARENA_FILE_RDONLY) == 0);
+    assert(sum(arena_file_root(reader)) == 5050 + 50005000);
+    arena_deinit(reader);
+    arena_deinit(arena);
+
+    assert(arena_file_open(arena, path, ARENA_FILE_RDONLY) == 0);
+    assert(sum(arena_file_root(arena)) == 5050 + 50005000);
+    arena_deinit(arena);
+
+    /* files that are not arenas are rejected */
+    FILE *file = fopen(path, "w");
+    fputs("not an arena", file);
+    fclose(file);
+    errno = 0;
+    assert(arena_file_open(arena, path, 0) == -1 && errno == EINVAL);
+    assert(arena->head == NULL);
+    unlink(path);
+    errno = 0;
+    assert(arena_file_open(arena, path, ARENA_FILE_RDONLY) == -1 && errno == ENOENT);
+
+    printf("file: ok\n");
+    return 0;
+}
@@ -0,0 +1,57 @@
+/* arena_compact moves live handle blocks together, keeps their contents and alignment, and releases regions */
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define COUNT 3000
+
+static arena_handle handles[COUNT];
+static size_t sizes[COUNT];
+
+static void check(p_arena arena) {
+    size_t i, j;
+    for (i = 0; i < COUNT; i ++) {
+        if (!handles[i]) continue;
+        unsigned char *ptr = arena_handle_deref(arena, handles[i]);
+        assert((size_t)ptr % ARENA_HANDLE_ALIGN == 0);
+        for (j = 0; j < sizes[i]; j ++) assert(ptr[j] == (i & 0xFF));
+    }
+}
+
+int main(void) {
+    p_arena arena = {0};
+    size_t i, round;
+
+    srand(5);
+    for (i = 0; i < COUNT; i ++) {
+        sizes[i] = 1 + rand() % 300;
+        handles[i] = arena_handle_alloc(arena, sizes[i]);
+        memset(arena_handle_deref(arena, handles[i]), (int)(i & 0xFF), sizes[i]);
+    }
+    check(arena);
+
+    for (round = 0; round < 3; round ++) {
+        for (i = round; i < COUNT; i += 3) {
+            if (!handles[i]) continue;
+            arena_handle_free(arena, handles[i]);
+            handles[i] = 0;
+        }
+        size_t total = arena->total;
+        arena_compact(arena);
+        assert(arena->total < total);
+        check(arena);
+    }
+    assert(arena->head->offset == 0 && arena->head == arena->tail);
+
+    /* freed handles are reused, and blocks allocated after a compaction are aligned too */
+    arena_handle handle = arena_handle_alloc(arena, 5);
+    assert(handle >= 1 && handle <= COUNT);
+    assert((size_t)arena_handle_deref(arena, handle) % ARENA_HANDLE_ALIGN == 0);
+    arena_alloc(arena, 3);
+    arena_handle other = arena_handle_alloc(arena, 40);
+    assert((size_t)arena_handle_deref(arena, other) % ARENA_HANDLE_ALIGN == 0);
+
+    arena_deinit(arena);
+    printf("handles: ok\n");
+    return 0;
+}
@@ -0,0 +1,282 @@
+/* random puts, removes and shrinks checked against a plain array, built once per compile-time mode, see Makefile */
+#include <assert.h>
+#include <stdio.h>
+#include "hashmap.h"
+
+#define KEYS 3000
+#define OPS  400000
+
+typedef struct { MAKE_HASHMAP(int); } map;
+#ifndef HASHMAP_ORDERED
+typedef struct { MAKE_HASHMAP_U64(int); } u64_map;
+#endif /* HASHMAP_ORDERED */
+
+static char keys[KEYS][32];
+static int ref[KEYS];
+
+static void make_keys(void) {
+    int i;
+    /* a few lengths, longer ones too, and the empty key */
+    for (i = 0; i < KEYS; i ++) {
+        snprintf(keys[i], sizeof(keys[i]), (i % 3) ? "k%d" : "a-longer-key-%d", i);
+        ref[i] = -1;
+    }
+    keys[0][0] = '\0';
+}
+
+/* every key agrees with the reference, and iterating visits each entry once */
+static void check_all(map *m) {
+    size_t count = 0, n = 0;
+    ssize_t i;
+    int k;
+    for (k = 0; k < KEYS; k ++) {
+        assert(hashmap_contains(*m, keys[k], strlen(keys[k])) == (ref[k] >= 0));
+        if (ref[k] >= 0) {
+            assert(hashmap_get(*m, keys[k], strlen(keys[k])) == ref[k]);
+            n ++;
+        }
+    }
+    hashmap_foreach(*m, i) {
+        const uint8_t *key = _hashmap_meta_key(&hashmap_meta(*m, i));
+        uint32_t len = hashmap_meta(*m, i).len;
+        assert(hashmap_contains(*m, key, len) && hashmap_at(*m, m->index) == hashmap_at(*m, i));
+        count ++;
+    }
+    assert(count == n && m->count == n);
+}
+
+static void test_random(void) {
+    map m = { 0 };
+    size_t n = 0;
+    int op;
+    hashmap_init(m);
+    srand(1);
+    for (op = 0; op < OPS; op ++) {
+        int k = rand() % KEYS, what = rand() % 16;
+        size_t len = strlen(keys[k]);
+        if (what < 8) {
+            n += ref[k] < 0;
+            ref[k] = op;
+            hashmap_put(m, op, keys[k], len);
+        } else if (what < 13) {
+            n -= ref[k] >= 0;
+            ref[k] = -1;
+            hashmap_remove(m, keys[k], len);
+        } else if (what < 15) {
+            assert(hashmap_contains(m, keys[k], len) == (ref[k] >= 0));
+            if (ref[k] >= 0) assert(hashmap_at(m, m.index) == ref[k]);
+        } else {
+            hashmap_shrink(m);
+        }
+        assert(m.count == n);
+        if (op % 50000 == 0) check_all(&m);
+    }
+    check_all(&m);
+
+    /* an explicit grow, then remove most keys and shrink back down */
+    hashmap_grow(m);
+    check_all(&m);
+    for (op = 0; op < KEYS; op ++) {
+        if (op % 8 == 0) continue;
+        ref[op] = -1;
+        hashmap_remove(m, keys[op], strlen(keys[op]));
+    }
+    while (m.capacity > HASHMAP_GROUP && m.count <= m.capacity / 4) {
+        size_t capacity = m.capacity;
+        hashmap_shrink(m);
+        assert(m.capacity == capacity / 2);
+    }
+    check_all(&m);
+    hashmap_deinit(m);
+}
+
+static void test_capacity(void) {
+    map m = { 0 };
+    int k;
+    /* rounded up to a power of 2, and filled to its load factor without growing */
+    hashmap_init_cap(m, 100);
+    assert(m.capacity == 128);
+    for (k = 0; k < 100; k ++) hashmap_put_nogrow(m, k, keys[k], strlen(keys[k]));
+    assert(m.count == 100 && m.capacity == 128);
+    for (k = 0; k < 100; k ++) assert(hashmap_get(m, keys[k], strlen(keys[k])) == k);
+    for (k = 100; k < KEYS; k ++) assert(!hashmap_contains(m, keys[k], strlen(keys[k])));
+    hashmap_deinit(m);
+}
+
+#ifdef HASHMAP_OWNED_KEYS
+static void make_owned_key(char *buf, int i) {
+    /* lengths on both sides of HASHMAP_INLINE_KEY */
+    int len = i % (2 * HASHMAP_INLINE_KEY), j;
+    for (j = 0; j < len; j ++) buf[j] = 'a' + (i + j) % 26;
+    snprintf(buf + len, 16, "%d", i);
+}
+
+static void test_owned(void) {
+    map m = { 0 };
+    char buf[64];
+    int i;
+    hashmap_init(m);
+    /* the map has its own copy, the buffer is overwritten after each put */
+    for (i = 0; i < 5000; i ++) {
+        make_owned_key(buf, i);
+        hashmap_put(m, i, buf, strlen(buf));
+        memset(buf, 'z', sizeof(buf));
+    }
+    for (i = 0; i < 5000; i += 3) {
+        make_owned_key(buf, i);
+        hashmap_remove(m, buf, strlen(buf));
+    }
+    hashmap_grow(m);
+    for (i = 0; i < 5000; i ++) {
+        make_owned_key(buf, i);
+        assert(hashmap_contains(m, buf, strlen(buf)) == (i % 3 != 0));
+        if (i % 3) assert(hashmap_at(m, m.index) == i);
+    }
+    hashmap_deinit(m);
+}
+#endif /* HASHMAP_OWNED_KEYS */
+
+#ifdef HASHMAP_ARENA
+static void test_arena(void) {
+    p_arena arena = {0};
+    map heap = { 0 };
+    int round, k;
+    for (round = 0; round < 3; round ++) {
+        map m = { 0 };
+        /* the arena is left unaligned, and after a reset holds the garbage of the last round */
+        (void)arena_alloc(arena, 8);
+        memset(arena_alloc(arena, 1 << 16), 0xAB, 1 << 16);
+        arena_reset(arena);
+        (void)arena_alloc(arena, 8);
+        hashmap_init_arena(m, arena);
+        for (k = 0; k < KEYS; k ++) hashmap_put(m, k, keys[k], strlen(keys[k]));
+        for (k = 0; k < KEYS; k += 2) hashmap_remove(m, keys[k], strlen(keys[k]));
+        while (m.capacity > HASHMAP_GROUP && m.count <= m.capacity / 4) hashmap_shrink(m);
+        for (k = 0; k < KEYS; k ++) {
+            assert(hashmap_contains(m, keys[k], strlen(keys[k])) == (k & 1));
+            if (k & 1) assert(hashmap_at(m, m.index) == k);
+        }
+#ifndef HASHMAP_ORDERED
+        {
+            u64_map u = { 0 };
+            hashmap_init_arena(u, arena);
+            for (k = 0; k < KEYS; k ++) hashmap_u64_put(u, k, (uint64_t)k);
+            for (k = 0; k < KEYS; k ++) assert(hashmap_u64_get(u, (uint64_t)k) == k);
+            hashmap_u64_deinit(u);
+        }
+#endif /* HASHMAP_ORDERED */
+        hashmap_deinit(m);
+        arena_reset(arena);
+    }
+    /* hashmap_init goes back to the heap, even over a map that was in an arena */
+    heap.arena = arena;
+    hashmap_init(heap);
+    assert(heap.arena == NULL);
+    hashmap_put(heap, 1, "heap", 4);
+    assert(hashmap_get(heap, "heap", 4) == 1);
+    hashmap_deinit(heap);
+    arena_deinit(arena);
+}
+#endif /* HASHMAP_ARENA */
+
+#ifdef HASHMAP_ORDERED
+static void test_ordered(void) {
+    static int order[KEYS + 1];
+    map m = { 0 };
+    size_t n = 0, at = 0;
+    ssize_t i;
+    int k;
+    hashmap_init(m);
+    /* put in a scattered order, with a few removes and updates on the way so the map rehashes over holes */
+    for (k = 0; k < KEYS; k ++) {
+        int key = k * 7 % KEYS;
+        hashmap_put(m, key, keys[key], strlen(keys[key]));
+        order[n ++] = key;
+        if (k % 5 == 4) {
+            hashmap_remove(m, keys[order[n - 3]], strlen(keys[order[n - 3]]));
+            memmove(&order[n - 3], &order[n - 2], 2 * sizeof(*order));
+            n --;
+        }
+        if (k % 7 == 6) hashmap_put(m, order[0], keys[order[0]], strlen(keys[order[0]]));
+    }
+    /* put again after a remove, it goes last */
+    hashmap_remove(m, keys[order[0]], strlen(keys[order[0]]));
+    hashmap_put(m, order[0], keys[order[0]], strlen(keys[order[0]]));
+    order[n] = order[0];
+    assert(m.count == n);
+    hashmap_foreach(m, i) {
+        assert(hashmap_at(m, i) == order[at + 1]);
+        at ++;
+    }
+    assert(at == n);
+    hashmap_deinit(m);
+}
+#else
+static void test_u64(void) {
+    u64_map m = { 0 };
+    size_t n = 0, count;
+    ssize_t i;
+    int op, k;
+    /* small keys and keys with only high bits set, against ref */
+    hashmap_init(m);
+    for (k = 0; k < KEYS; k ++) ref[k] = -1;
+    srand(2);
+    for (op = 0; op < OPS; op ++) {
+        int what = rand() % 16;
+        uint64_t key;
+        k = rand() % KEYS;
+        key = (k & 1) ? (uint64_t)k << 40 : (uint64_t)k;
+        if (what < 8) {
+            n += ref[k] < 0;
+            ref[k] = op;
+            hashmap_u64_put(m, op, key);
+        } else if (what < 13) {
+            n -= ref[k] >= 0;
+            ref[k] = -1;
+            hashmap_u64_remove(m, key);
+        } else if (what < 15) {
+            assert(hashmap_u64_contains(m, key) == (ref[k] >= 0));
+            if (ref[k] >= 0) assert(hashmap_at(m, m.index) == ref[k] && hashmap_u64_key(m, m.index) == key);
+        } else {
+            hashmap_shrink(m);
+        }
+        assert(m.count == n);
+    }
+    count = 0;
+    hashmap_foreach(m, i) {
+        uint64_t key = hashmap_u64_key(m, i);
+        k = (int)((key >> 40) ? key >> 40 : key);
+        assert(ref[k] == hashmap_at(m, i));
+        count ++;
+    }
+    assert(count == n);
+    hashmap_u64_deinit(m);
+
+    /* every slot full: a miss still ends after going around the table once */
+    hashmap_init_cap(m, HASHMAP_GROUP);
+    for (k = 0; k < (int)HASHMAP_GROUP; k ++) hashmap_u64_put_nogrow(m, k, k);
+    assert(m.count == m.capacity);
+    assert(!hashmap_u64_contains(m, 99));
+    for (k = 0; k < (int)HASHMAP_GROUP; k ++) assert(hashmap_u64_get(m, k) == k);
+    hashmap_u64_deinit(m);
+}
+#endif /* HASHMAP_ORDERED */
+
+int main(void) {
+    make_keys();
+    test_random();
+    test_capacity();
+#ifdef HASHMAP_OWNED_KEYS
+    test_owned();
+#endif /* HASHMAP_OWNED_KEYS */
+#ifdef HASHMAP_ARENA
+    test_arena();
+#endif /* HASHMAP_ARENA */
+#ifdef HASHMAP_ORDERED
+    test_ordered();
+#else
+    test_u64();
+#endif /* HASHMAP_ORDERED */
+    printf("hashmap: ok\n");
+    return 0;
+}
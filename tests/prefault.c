@@ -0,0 +1,53 @@
+/* memory faulted in by ARENA_PREFAULT, arena_prefault or ARENA_FILE_PREFAULT takes no page faults when written */
+#define ARENA_MMAP_BACKEND
+#include <assert.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include "arena.h"
+
+#define SIZE (4u << 20)
+
+static long faults(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+/* page faults taken by writing the whole block */
+static long touch(char *block) {
+    long before = faults();
+    memset(block, 1, SIZE);
+    return faults() - before;
+}
+
+int main(void) {
+    p_arena arena = {0};
+    char path[64];
+
+    /* the baseline: every page faults on first touch, unless huge pages make it a handful of faults */
+    long cold = touch(arena_alloc(arena, SIZE));
+    arena_deinit(arena);
+    if (cold < (long)(SIZE / _arena_page_size() / 2)) {
+        printf("prefault: skipped, %ld faults for %u bytes\n", cold, SIZE);
+        return 0;
+    }
+
+    arena_init_flags(arena, ARENA_PREFAULT);
+    assert(touch(arena_alloc(arena, SIZE)) < cold / 2);
+    arena_deinit(arena);
+
+    arena_prefault(arena, sizeof(struct _arena_alloc_header) + SIZE);
+    assert(touch(arena_alloc(arena, SIZE)) < cold / 2);
+    arena_deinit(arena);
+
+    snprintf(path, sizeof(path), "/tmp/arena-prefault-%d", (int)getpid());
+    unlink(path);
+    assert(arena_file_open(arena, path, ARENA_FILE_PREFAULT) == 0);
+    assert(arena->flags & ARENA_PREFAULT);
+    assert(touch(arena_alloc(arena, SIZE)) < cold / 2);
+    arena_deinit(arena);
+    unlink(path);
+
+    printf("prefault: ok\n");
+    return 0;
+}
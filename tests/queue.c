@@ -0,0 +1,52 @@
+/* batches pushed by several producers all reach the consumer, each in the order its producer pushed them */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define PRODUCERS 4
+#define BATCHES 5000
+
+static p_arena_queue queue;
+
+static void *producer(void *arg) {
+    size_t id = (size_t)arg, i;
+    for (i = 0; i < BATCHES; i ++) {
+        p_arena arena = {0};
+        size_t *batch = arena_alloc(arena, 3 * sizeof(size_t));
+        /* leaves the queue node that follows misaligned unless push aligns it */
+        arena_alloc(arena, 5);
+        batch[0] = id;
+        batch[1] = i;
+        batch[2] = id ^ i;
+        arena_queue_push(queue, arena);
+        assert(arena->head == NULL);
+    }
+    return NULL;
+}
+
+int main(void) {
+    pthread_t threads[PRODUCERS];
+    size_t next[PRODUCERS] = {0}, received = 0, i;
+
+    arena_queue_init(queue);
+    for (i = 0; i < PRODUCERS; i ++) pthread_create(&threads[i], NULL, producer, (void *)i);
+
+    while (received < PRODUCERS * BATCHES) {
+        p_arena arena = {0};
+        if (!arena_queue_pop(queue, arena)) continue;
+        size_t *batch = arena_root(arena);
+        assert(batch[0] < PRODUCERS);
+        assert(batch[1] == next[batch[0]]);
+        assert(batch[2] == (batch[0] ^ batch[1]));
+        next[batch[0]] ++;
+        arena_deinit(arena);
+        received ++;
+    }
+
+    for (i = 0; i < PRODUCERS; i ++) pthread_join(threads[i], NULL);
+    p_arena arena = {0};
+    assert(!arena_queue_pop(queue, arena));
+    printf("queue: ok\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+/* arena_realloc gives the tail of a region back when it shrinks or moves the last block, and grows it in place */
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define HDR sizeof(struct _arena_alloc_header)
+
+static void test_shrink(void) {
+    p_arena arena = {0};
+    arena_init(arena);
+    struct _memory_region *region = arena->head;
+
+    char *a = arena_alloc(arena, 104);
+    char *b = arena_alloc(arena, 1000);
+    assert(region->offset == 2 * HDR + 1104);
+
+    /* the last block gives its tail back */
+    memset(b, 'b', 1000);
+    assert(arena_realloc(arena, b, 200) == b);
+    assert(region->offset == 2 * HDR + 304);
+    assert(b[199] == 'b');
+
+    /* an earlier one only changes its size, the bytes after it are in use */
+    assert(arena_realloc(arena, a, 10) == a);
+    assert(region->offset == 2 * HDR + 304);
+    assert(((struct _arena_alloc_header *)(a - HDR))->size == 10);
+
+    arena_deinit(arena);
+}
+
+static void test_grow_in_place(void) {
+    p_arena arena = {0};
+    arena_init(arena);
+    struct _memory_region *region = arena->head;
+
+    char *a = arena_alloc(arena, 64);
+    char *b = arena_alloc(arena, 64);
+    memset(a, 'a', 64);
+
+    /* a is followed by b, so it has to move */
+    char *moved = arena_realloc(arena, a, 128);
+    assert(moved != a && moved[63] == 'a');
+    arena_free(arena, moved);
+    assert(region->offset == 2 * HDR + 128);
+
+    /* once the blocks after it are freed it is the last one again, and grows where it is */
+    arena_free(arena, b);
+    assert(region->offset == HDR + 64);
+    assert(arena_realloc(arena, a, 4000) == a);
+    assert(region->offset == HDR + 4000);
+    assert(a[63] == 'a');
+
+    arena_deinit(arena);
+}
+
+static void test_move(void) {
+    p_arena arena = {0};
+    arena_init(arena);
+    struct _memory_region *region = arena->head;
+
+    arena_alloc(arena, 32);
+    char *a = arena_alloc(arena, 256);
+    memset(a, 'a', 256);
+    size_t before = region->offset;
+
+    /* too big for what is left of the region: it moves to a new one and the old block is released */
+    char *moved = arena_realloc(arena, a, region->size);
+    assert(moved != a && arena->tail != region);
+    assert(moved[0] == 'a' && moved[255] == 'a');
+    assert(region->offset == before - HDR - 256);
+    assert(arena->tail->offset == HDR + region->size);
+
+    arena_deinit(arena);
+}
+
+int main(void) {
+    test_shrink();
+    test_grow_in_place();
+    test_move();
+    printf("realloc: ok\n");
+    return 0;
+}
@@ -0,0 +1,36 @@
+/* regions start on a page, span whole pages, and their data starts on a cache line after a one-line header */
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+static void check(struct _memory_region *region) {
+    assert((size_t)region % ARENA_PAGE_SIZE == 0);
+    assert((sizeof(*region) + region->size) % ARENA_PAGE_SIZE == 0);
+    assert((size_t)region->mem % ARENA_CACHELINE == 0);
+}
+
+int main(void) {
+    p_arena arena = {0};
+    struct _memory_region *region;
+    size_t sizes[] = { 8, 104, ARENA_PAGE_SIZE, 3 * ARENA_PAGE_SIZE + 8, 1 << 20 }, i;
+
+    assert(sizeof(struct _memory_region) == ARENA_CACHELINE);
+
+    arena_init(arena);
+    assert(sizeof(*arena->head) + arena->head->size == ARENA_DEFAULT_CAPACITY);
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i ++) {
+        char *ptr = arena_alloc(arena, sizes[i]);
+        region = arena->tail;
+        assert(ptr >= region->mem && ptr + sizes[i] <= region->mem + region->size);
+    }
+    for (region = arena->head; region; region = region->next) check(region);
+    arena_deinit(arena);
+
+    arena_init_contiguous(arena, 10000);
+    check(arena->head);
+    assert(arena->head->size >= 10000);
+    arena_deinit(arena);
+
+    printf("regions: ok\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* regions without room are dropped from the search list, and come back once freeing makes room in them */
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define HDR sizeof(struct _arena_alloc_header)
+
+static int searched(p_arena arena, struct _memory_region *region) {
+    struct _memory_region *avail;
+    for (avail = arena->avail; avail; avail = avail->next_avail) if (avail == region) return 1;
+    return 0;
+}
+
+/* fill the first region of a new arena up to `left` free bytes, and allocate elsewhere so it gets retired */
+static char *fill(p_arena arena, size_t left) {
+    arena_init(arena);
+    char *block = arena_alloc(arena, arena->head->size - HDR - left);
+    arena_alloc(arena, 104);
+    return block;
+}
+
+int main(void) {
+    p_arena arena = {0};
+    size_t i;
+
+    /* a region with less than ARENA_RETIRE_THRESHOLD bytes free is dropped once it is passed over */
+    char *block = fill(arena, 16);
+    assert(arena->head->retired && !searched(arena, arena->head));
+    for (i = 0; i < 100; i ++) arena_alloc(arena, 8);
+    assert(arena->head->offset == arena->head->size - 16);
+
+    /* freeing its last block puts it back */
+    arena_free(arena, block);
+    assert(!arena->head->retired && searched(arena, arena->head));
+    assert(arena_alloc(arena, 1000) == arena->head->mem + HDR);
+    arena_deinit(arena);
+
+    /* so does shrinking its last block */
+    block = fill(arena, 16);
+    assert(arena_realloc(arena, block, 104) == block);
+    assert(!arena->head->retired && searched(arena, arena->head));
+    arena_deinit(arena);
+
+    /* and moving it out */
+    block = fill(arena, 16);
+    char *moved = arena_realloc(arena, block, 2 * arena->head->size);
+    assert(moved != block && arena->head->offset == 0 && searched(arena, arena->head));
+    arena_deinit(arena);
+
+    /* a region with enough room left stays searched */
+    fill(arena, 2 * ARENA_RETIRE_THRESHOLD);
+    assert(!arena->head->retired && searched(arena, arena->head));
+    arena_deinit(arena);
+
+    /* and a reset brings every region back */
+    fill(arena, 16);
+    arena_reset(arena);
+    assert(!arena->head->retired && searched(arena, arena->head));
+    arena_deinit(arena);
+
+    printf("retire: ok\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+/* arena_reset and arena_rewind discard allocations, with marks nested and across regions */
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+static void test_reset(void) {
+    p_arena arena = {0};
+    struct _memory_region *region;
+    size_t total;
+
+    arena_alloc(arena, 3000);
+    arena_alloc(arena, 6000);
+    arena_alloc(arena, 20000);
+    total = arena->total;
+    arena_reset(arena);
+    for (region = arena->head; region; region = region->next) assert(region->offset == 0);
+    assert(arena->total == total);
+
+    /* the regions are reused, the biggest one can take the biggest allocation again */
+    arena_alloc(arena, 20000);
+    assert(arena->total == total);
+    arena_deinit(arena);
+}
+
+static void test_nested(void) {
+    p_arena arena = {0};
+    struct _memory_region *region;
+    int round;
+
+    /* a mark taken on an empty arena rewinds to nothing */
+    s_arena_mark empty = arena_mark(arena);
+    arena_alloc(arena, 100);
+    arena_rewind(arena, empty);
+    assert(arena->head->offset == 0);
+
+    for (round = 0; round < 2; round ++) {
+        arena_alloc(arena, 3000);
+        arena_alloc(arena, 6000);
+        size_t head = arena->head->offset;
+        struct _memory_region *tail = arena->tail;
+        size_t tail_offset = tail->offset;
+
+        s_arena_mark outer = arena_mark(arena);
+        arena_alloc(arena, 4000);
+        s_arena_mark inner = arena_mark(arena);
+        struct _memory_region *inner_region = arena->tail;
+        size_t inner_offset = inner_region->offset;
+        arena_alloc(arena, 100);
+        arena_alloc(arena, 50000);
+        arena_rewind(arena, inner);
+        assert(inner_region->offset == inner_offset && arena->tail->offset == 0);
+
+        /* under the outer mark, older regions don't take allocations that the rewind couldn't release */
+        char *after = arena_alloc(arena, 2000);
+        assert(arena->head->offset == head);
+        assert(!(after > arena->head->mem && after < arena->head->mem + arena->head->size));
+
+        arena_rewind(arena, outer);
+        assert(arena->head->offset == head);
+        assert(tail->offset == tail_offset);
+        for (region = tail->next; region; region = region->next) assert(region->offset == 0);
+
+        /* without a mark the free space of the first region is used again */
+        char *ptr = arena_alloc(arena, 4000);
+        assert(ptr > arena->head->mem && ptr < arena->head->mem + arena->head->size);
+        arena_reset(arena);
+    }
+    arena_deinit(arena);
+}
+
+int main(void) {
+    test_reset();
+    test_nested();
+    printf("rewind: ok\n");
+    return 0;
+}
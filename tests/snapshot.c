@@ -0,0 +1,75 @@
+/* a contiguous arena saved with arena_save and mapped back with arena_load_mmap keeps its relptr links */
+#define ARENA_MMAP_BACKEND
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+struct node {
+    arena_relptr    next;
+    size_t          value;
+};
+
+static char path[64];
+
+static void test_round_trip(void) {
+    p_arena arena = {0}, loaded = {0};
+    struct node *head = NULL, *node;
+    size_t i;
+
+    arena_init_contiguous(arena, 1 << 16);
+    struct node *root = arena_alloc(arena, sizeof(*root));
+    arena_relptr_set(root->next, NULL);
+    root->value = 1000;
+    for (i = 0; i < 1000; i ++) {
+        node = arena_alloc(arena, sizeof(*node));
+        node->value = i;
+        arena_relptr_set(node->next, head);
+        head = node;
+    }
+    arena_relptr_set(root->next, head);
+    assert(arena_relptr_get(root->next, struct node) == head);
+    assert(arena_save(arena, path) == 0);
+
+    /* mapped at another address, with room to keep growing */
+    assert(arena_load_mmap(loaded, path, 1 << 20) == 0);
+    assert(loaded->head->mem != arena->head->mem);
+    arena_deinit(arena);
+
+    root = arena_root(loaded);
+    assert(root->value == 1000);
+    for (i = 1000, node = arena_relptr_get(root->next, struct node); node; node = arena_relptr_get(node->next, struct node)) {
+        assert(node->value == -- i);
+    }
+    assert(i == 0);
+    node = arena_alloc(loaded, 1 << 19);
+    assert((char *)node > loaded->head->mem && loaded->head == loaded->tail);
+
+    arena_deinit(loaded);
+}
+
+static void test_errors(void) {
+    p_arena arena = {0};
+
+    /* only single region arenas can be saved */
+    arena_alloc(arena, 16);
+    arena_alloc(arena, 1 << 16);
+    errno = 0;
+    assert(arena_save(arena, path) == -1 && errno == EINVAL);
+    arena_deinit(arena);
+
+    FILE *file = fopen(path, "w");
+    fputs("not a snapshot", file);
+    fclose(file);
+    errno = 0;
+    assert(arena_load_mmap(arena, path, 0) == -1 && errno == EINVAL);
+    assert(arena->head == NULL);
+}
+
+int main(void) {
+    snprintf(path, sizeof(path), "/tmp/arena-snapshot-%d", (int)getpid());
+    test_round_trip();
+    test_errors();
+    unlink(path);
+    printf("snapshot: ok\n");
+    return 0;
+}
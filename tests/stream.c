@@ -0,0 +1,37 @@
+/* streaming copies match memcpy for every size and alignment, even with the threshold set below a vector */
+#define ARENA_STREAM_THRESHOLD 1
+#include <assert.h>
+#include <stdio.h>
+#include "arena.h"
+
+#define LARGE (3u << 20)
+
+int main(void) {
+    char src[600], dst[700];
+    size_t offset, size, i;
+
+    for (i = 0; i < sizeof(src); i ++) src[i] = (char)(i * 7);
+    for (offset = 0; offset < 64; offset ++) {
+        for (size = 0; size < 520; size ++) {
+            memset(dst, 0x55, sizeof(dst));
+            _arena_copy(dst + offset, src, size);
+            assert(memcmp(dst + offset, src, size) == 0);
+            assert(dst[offset + size] == 0x55 && (offset == 0 || dst[offset - 1] == 0x55));
+        }
+    }
+
+    /* large clones and realloc moves go through the same path */
+    p_arena arena = {0};
+    char *payload = malloc(LARGE);
+    for (i = 0; i < LARGE; i ++) payload[i] = (char)(i % 251);
+    char *clone = arena_memclone(arena, payload, LARGE);
+    assert(memcmp(clone, payload, LARGE) == 0);
+    arena_alloc(arena, 8);
+    char *moved = arena_realloc(arena, clone, 2 * LARGE);
+    assert(moved != clone && memcmp(moved, payload, LARGE) == 0);
+    arena_deinit(arena);
+    free(payload);
+
+    printf("stream: ok\n");
+    return 0;
+}
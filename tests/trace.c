@@ -0,0 +1,57 @@
+/* ARENA_TRACE_HOOK sees every probe, with the arguments listed at the top of arena.h */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+struct event {
+    const char  *name;
+    const void  *ptr;
+    size_t      size;
+    size_t      extra;
+};
+
+static struct event events[64];
+static size_t count;
+
+static void record(const char *name, const void *ptr, size_t size, size_t extra) {
+    struct event event = { name, ptr, size, extra };
+    events[count ++] = event;
+}
+
+#define ARENA_TRACE
+#define ARENA_TRACE_HOOK(event, arena, p, n, x) record((event), (p), (size_t)(n), (size_t)(x))
+#include "arena.h"
+
+static const struct event *expect(size_t index, const char *name) {
+    assert(index < count && strcmp(events[index].name, name) == 0);
+    return &events[index];
+}
+
+int main(void) {
+    p_arena arena = {0};
+    void *ptrs[4];
+
+    char *a = arena_alloc(arena, 40);
+    assert(expect(0, "region")->ptr == arena->head);
+    assert(expect(1, "alloc")->ptr == a && events[1].size == 40 && events[1].extra == 0);
+
+    char *b = arena_alloc_aligned(arena, 24, 64);
+    assert(expect(2, "alloc")->ptr == b && events[2].size == 24 && events[2].extra == 64);
+
+    arena_alloc_many(arena, 4, 16, ptrs);
+    assert(expect(3, "alloc_many")->ptr == ptrs && events[3].size == 16 && events[3].extra == 4);
+
+    char *c = arena_realloc(arena, a, 8);
+    assert(expect(4, "realloc")->ptr == c && events[4].size == 8 && events[4].extra == (size_t)a);
+
+    arena_free(arena, ptrs[3]);
+    assert(expect(5, "free")->ptr == ptrs[3] && events[5].size == 16);
+
+    size_t total = arena->total;
+    arena_deinit(arena);
+    assert(expect(6, "deinit")->ptr == NULL && events[6].size == total);
+    assert(count == 7);
+
+    printf("trace: ok\n");
+    return 0;
+}